@@ -0,0 +1,247 @@
+#include "pch.h"
+#include "config.h"
+#include "driverlog.h"
+#include <openvr_driver.h>
+#include <algorithm>
+#include <stdlib.h>
+
+// keys for use with the settings API
+static const char* const k_pch_optiforge_Section = "driver_optiforge";
+static const char* const k_pch_optiforge_SerialNumber_String = "serialNumber";
+static const char* const k_pch_optiforge_ModelNumber_String = "modelNumber";
+static const char* const k_pch_optiforge_WindowX_Int32 = "windowX";
+static const char* const k_pch_optiforge_WindowY_Int32 = "windowY";
+static const char* const k_pch_optiforge_WindowWidth_Int32 = "windowWidth";
+static const char* const k_pch_optiforge_WindowHeight_Int32 = "windowHeight";
+static const char* const k_pch_optiforge_RenderWidth_Int32 = "renderWidth";
+static const char* const k_pch_optiforge_RenderHeight_Int32 = "renderHeight";
+static const char* const k_pch_optiforge_SecondsFromVsyncToPhotons_Float = "secondsFromVsyncToPhotons";
+static const char* const k_pch_optiforge_DisplayFrequency_Float = "displayFrequency";
+static const char* const k_pch_optiforge_IP = "ip";
+static const char* const k_pch_optiforge_Port = "port";
+static const char* const k_pch_optiforge_Transport_String = "transport";
+static const char* const k_pch_optiforge_ShmName_String = "shmName";
+static const char* const k_pch_optiforge_AdaptiveResolution_Bool = "adaptiveResolution";
+static const char* const k_pch_optiforge_RenderScaleMin_Float = "renderScaleMin";
+static const char* const k_pch_optiforge_RenderScaleMax_Float = "renderScaleMax";
+static const char* const k_pch_optiforge_RenderGovernorTrace_String = "renderGovernorTrace";
+static const char* const k_pch_optiforge_RenderScaleLast_Float = "renderScaleLast";
+static const char* const k_pch_optiforge_ReceiveThreadAffinity_String = "receiveThreadAffinity";
+static const char* const k_pch_optiforge_ReceiveThreadPriority_String = "receiveThreadPriority";
+static const char* const k_pch_optiforge_DisplayLinkExperimental_Bool = "displayLinkExperimental";
+static const char* const k_pch_optiforge_DisplayLinkPort_Int32 = "displayLinkPort";
+static const char* const k_pch_optiforge_DisplayLinkSlicesPerEye_Int32 = "displayLinkSlicesPerEye";
+static const char* const k_pch_optiforge_DisplayLinkWorkers_Int32 = "displayLinkWorkers";
+static const char* const k_pch_optiforge_DisplayLinkQuantBits_Int32 = "displayLinkQuantBits";
+static const char* const k_pch_optiforge_DisplayLinkTestPattern_Bool = "displayLinkTestPattern";
+static const char* const k_pch_optiforge_HandTracking_Bool = "handTracking";
+static const char* const k_pch_optiforge_HandPort_Int32 = "handPort";
+
+void ReadConfigFromSettings(OptiforgeConfig_t* pConfig)
+{
+	pConfig->flIPD = vr::VRSettings()->GetFloat(vr::k_pch_SteamVR_Section, vr::k_pch_SteamVR_IPD_Float);
+
+	char buf[1024];
+	vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_SerialNumber_String, buf, sizeof(buf));
+	pConfig->sSerialNumber = buf;
+
+	vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_ModelNumber_String, buf, sizeof(buf));
+	pConfig->sModelNumber = buf;
+
+	pConfig->nWindowX = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_WindowX_Int32);
+	pConfig->nWindowY = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_WindowY_Int32);
+	pConfig->nWindowWidth = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_WindowWidth_Int32);
+	pConfig->nWindowHeight = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_WindowHeight_Int32);
+	pConfig->nRenderWidth = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_RenderWidth_Int32);
+	pConfig->nRenderHeight = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_RenderHeight_Int32);
+	pConfig->flSecondsFromVsyncToPhotons = vr::VRSettings()->GetFloat(k_pch_optiforge_Section, k_pch_optiforge_SecondsFromVsyncToPhotons_Float);
+	pConfig->flDisplayFrequency = vr::VRSettings()->GetFloat(k_pch_optiforge_Section, k_pch_optiforge_DisplayFrequency_Float);
+	pConfig->nPort = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_Port);
+
+	pConfig->bAdaptiveResolution = vr::VRSettings()->GetBool(k_pch_optiforge_Section, k_pch_optiforge_AdaptiveResolution_Bool);
+	pConfig->flRenderScaleMin = vr::VRSettings()->GetFloat(k_pch_optiforge_Section, k_pch_optiforge_RenderScaleMin_Float);
+	pConfig->flRenderScaleMax = vr::VRSettings()->GetFloat(k_pch_optiforge_Section, k_pch_optiforge_RenderScaleMax_Float);
+	if (pConfig->flRenderScaleMax <= 0.f)
+		pConfig->flRenderScaleMax = 1.f;
+	if (pConfig->flRenderScaleMin <= 0.f || pConfig->flRenderScaleMin > pConfig->flRenderScaleMax)
+		pConfig->flRenderScaleMin = pConfig->flRenderScaleMax;
+
+	vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_RenderGovernorTrace_String, buf, sizeof(buf));
+	pConfig->sRenderGovernorTrace = buf;
+
+	vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_IP, buf, sizeof(buf));
+	pConfig->sIP = buf;
+
+	// "tcp" (default) connects to ip:port, "shm" reads from a producer on this PC
+	vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_Transport_String, buf, sizeof(buf));
+	pConfig->bUseShm = !_stricmp(buf, "shm");
+
+	vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_ShmName_String, buf, sizeof(buf));
+	pConfig->sShmName = buf;
+
+	// One bit per logical CPU, 0 lets the OS place the thread. A string so that CPUs 32 and
+	// up fit; decimal or 0x hex. Older settings files stored a number, which still reads.
+	vr::EVRSettingsError eAffinityError = vr::VRSettingsError_None;
+	vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_ReceiveThreadAffinity_String, buf, sizeof(buf), &eAffinityError);
+	if (eAffinityError == vr::VRSettingsError_None) {
+		char* pchEnd = buf;
+		pConfig->ulReceiveThreadAffinity = strtoull(buf, &pchEnd, 0);
+		if (pchEnd == buf || *pchEnd != 0) {
+			DriverLog("driver_optiforge: receiveThreadAffinity \"%s\" isn't a number, ignoring it\n", buf);
+			pConfig->ulReceiveThreadAffinity = 0;
+		}
+	}
+	else {
+		pConfig->ulReceiveThreadAffinity = (uint32_t)vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_ReceiveThreadAffinity_String);
+	}
+
+	vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_ReceiveThreadPriority_String, buf, sizeof(buf));
+	pConfig->eReceiveThreadPriority = ParseThreadPriority(buf);
+
+	pConfig->bDisplayLinkExperimental = vr::VRSettings()->GetBool(k_pch_optiforge_Section, k_pch_optiforge_DisplayLinkExperimental_Bool);
+	pConfig->nDisplayLinkPort = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_DisplayLinkPort_Int32);
+	pConfig->unDisplayLinkSlicesPerEye = (uint32_t)std::max(vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_DisplayLinkSlicesPerEye_Int32), 1);
+	pConfig->unDisplayLinkWorkers = (uint32_t)std::max(vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_DisplayLinkWorkers_Int32), 1);
+	pConfig->ucDisplayLinkQuantBits = (uint8_t)std::min(std::max(vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_DisplayLinkQuantBits_Int32), 0), 7);
+	pConfig->bDisplayLinkTestPattern = vr::VRSettings()->GetBool(k_pch_optiforge_Section, k_pch_optiforge_DisplayLinkTestPattern_Bool);
+
+	pConfig->bHandTracking = vr::VRSettings()->GetBool(k_pch_optiforge_Section, k_pch_optiforge_HandTracking_Bool);
+	pConfig->nHandPort = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_HandPort_Int32);
+}
+
+// Kept in the settings because it is only written when a session ends, long after every
+// snapshot was read. Not part of OptiforgeConfig_t, so writing it never publishes one.
+float ReadLastRenderScale()
+{
+	return vr::VRSettings()->GetFloat(k_pch_optiforge_Section, k_pch_optiforge_RenderScaleLast_Float);
+}
+
+void WriteLastRenderScale(float flScale)
+{
+	vr::VRSettings()->SetFloat(k_pch_optiforge_Section, k_pch_optiforge_RenderScaleLast_Float, flScale);
+}
+
+bool TransportChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig)
+{
+	if (oldConfig.bUseShm != newConfig.bUseShm)
+		return true;
+	if (newConfig.bUseShm)
+		return oldConfig.sShmName != newConfig.sShmName;
+	return oldConfig.sIP != newConfig.sIP || oldConfig.nPort != newConfig.nPort;
+}
+
+// the display properties that are updated in place
+bool DisplayChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig)
+{
+	return oldConfig.flSecondsFromVsyncToPhotons != newConfig.flSecondsFromVsyncToPhotons
+		|| oldConfig.flDisplayFrequency != newConfig.flDisplayFrequency
+		|| oldConfig.flIPD != newConfig.flIPD;
+}
+
+// SteamVR reads these from the display component once, when the headset is activated
+bool DisplaySizeChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig)
+{
+	return oldConfig.nWindowX != newConfig.nWindowX
+		|| oldConfig.nWindowY != newConfig.nWindowY
+		|| oldConfig.nWindowWidth != newConfig.nWindowWidth
+		|| oldConfig.nWindowHeight != newConfig.nWindowHeight
+		|| oldConfig.nRenderWidth != newConfig.nRenderWidth
+		|| oldConfig.nRenderHeight != newConfig.nRenderHeight;
+}
+
+bool RenderGovernorChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig)
+{
+	return oldConfig.bAdaptiveResolution != newConfig.bAdaptiveResolution
+		|| oldConfig.flRenderScaleMin != newConfig.flRenderScaleMin
+		|| oldConfig.flRenderScaleMax != newConfig.flRenderScaleMax
+		|| oldConfig.flDisplayFrequency != newConfig.flDisplayFrequency
+		|| oldConfig.sRenderGovernorTrace != newConfig.sRenderGovernorTrace;
+}
+
+bool ThreadsChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig)
+{
+	return oldConfig.ulReceiveThreadAffinity != newConfig.ulReceiveThreadAffinity
+		|| oldConfig.eReceiveThreadPriority != newConfig.eReceiveThreadPriority;
+}
+
+bool DisplayLinkChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig)
+{
+	return oldConfig.bDisplayLinkExperimental != newConfig.bDisplayLinkExperimental
+		|| oldConfig.nDisplayLinkPort != newConfig.nDisplayLinkPort
+		|| oldConfig.unDisplayLinkSlicesPerEye != newConfig.unDisplayLinkSlicesPerEye
+		|| oldConfig.unDisplayLinkWorkers != newConfig.unDisplayLinkWorkers
+		|| oldConfig.ucDisplayLinkQuantBits != newConfig.ucDisplayLinkQuantBits
+		|| oldConfig.bDisplayLinkTestPattern != newConfig.bDisplayLinkTestPattern;
+}
+
+const OptiforgeConfig_t* CConfigStore::Publish(const OptiforgeConfig_t& config)
+{
+	std::lock_guard<std::mutex> lock(m_publishMutex);
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	m_vecRetired.erase(std::remove_if(m_vecRetired.begin(), m_vecRetired.end(), [now](const RetiredSnapshot_t& retired) {
+		return now - retired.retiredAt > k_configSnapshotGrace;
+	}), m_vecRetired.end());
+
+	std::unique_ptr<const OptiforgeConfig_t> pPrevious = std::move(m_pOwnedCurrent);
+	m_pOwnedCurrent.reset(new OptiforgeConfig_t(config));
+	const OptiforgeConfig_t* pOld = m_pCurrent.exchange(m_pOwnedCurrent.get(), std::memory_order_acq_rel);
+
+	if (pPrevious)
+	{
+		RetiredSnapshot_t retired;
+		retired.pConfig = std::move(pPrevious);
+		retired.retiredAt = now;
+		m_vecRetired.push_back(std::move(retired));
+	}
+	return pOld;
+}
+
+CConfigReloader::CConfigReloader(CConfigStore* pStore, ChangedCallback_t callback)
+	: m_pStore(pStore), m_callback(callback)
+{
+}
+
+void CConfigReloader::Wake()
+{
+	// take the lock so the notify can't slip in between the predicate check and the wait
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cv.notify_one();
+}
+
+void CConfigReloader::RequestReload()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bReloadRequested = true;
+	}
+	m_cv.notify_one();
+}
+
+void CConfigReloader::Run(const CStopToken& stop)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_cv.wait(lock, [this, &stop] { return m_bReloadRequested || stop.StopRequested(); });
+		if (stop.StopRequested())
+			break;
+		m_bReloadRequested = false;
+
+		lock.unlock();
+
+		OptiforgeConfig_t newConfig;
+		ReadConfigFromSettings(&newConfig);
+
+		const OptiforgeConfig_t* pOldConfig = m_pStore->Get();
+		if (TransportChanged(*pOldConfig, newConfig) || DisplayChanged(*pOldConfig, newConfig) || DisplaySizeChanged(*pOldConfig, newConfig)
+			|| RenderGovernorChanged(*pOldConfig, newConfig) || ThreadsChanged(*pOldConfig, newConfig) || DisplayLinkChanged(*pOldConfig, newConfig))
+		{
+			DriverLog("driver_optiforge: settings changed, publishing new configuration\n");
+			m_pStore->Publish(newConfig);
+			m_callback(*pOldConfig, *m_pStore->Get());
+		}
+
+		lock.lock();
+	}
+}
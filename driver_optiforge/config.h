@@ -0,0 +1,135 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "thread_runtime.h"
+
+// --------------------------------------------------------------------------
+// Purpose: Everything read from the driver_optiforge settings section. An
+//          instance is never modified once it has been published.
+// --------------------------------------------------------------------------
+struct OptiforgeConfig_t
+{
+	std::string sSerialNumber;
+	std::string sModelNumber;
+
+	int32_t nWindowX = 0;
+	int32_t nWindowY = 0;
+	int32_t nWindowWidth = 0;
+	int32_t nWindowHeight = 0;
+	int32_t nRenderWidth = 0;
+	int32_t nRenderHeight = 0;
+	float flSecondsFromVsyncToPhotons = 0.f;
+	float flDisplayFrequency = 0.f;
+	float flIPD = 0.f;
+
+	bool bAdaptiveResolution = false;
+	float flRenderScaleMin = 1.f;
+	float flRenderScaleMax = 1.f;
+	std::string sRenderGovernorTrace;	// CSV file the governor's input is recorded to, empty for none
+
+	uint64_t ulReceiveThreadAffinity = 0;
+	EThreadPriority eReceiveThreadPriority = ThreadPriority_Elevated;
+
+	bool bDisplayLinkExperimental = false;	// only the test pattern feeds it until compositor frames are captured
+	int nDisplayLinkPort = 31001;
+	uint32_t unDisplayLinkSlicesPerEye = 4;
+	uint32_t unDisplayLinkWorkers = 2;
+	uint8_t ucDisplayLinkQuantBits = 0;
+	bool bDisplayLinkTestPattern = false;
+
+	bool bHandTracking = false;
+	int nHandPort = 31002;
+
+	bool bUseShm = false;
+	std::string sShmName;
+	std::string sIP;
+	int nPort = 31000;
+};
+
+extern void ReadConfigFromSettings(OptiforgeConfig_t* pConfig);
+// The render governor's scale at the end of the previous session, 0 when there is none
+extern float ReadLastRenderScale();
+extern void WriteLastRenderScale(float flScale);
+extern bool TransportChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig);
+extern bool DisplayChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig);
+extern bool DisplaySizeChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig);
+extern bool RenderGovernorChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig);
+extern bool ThreadsChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig);
+extern bool DisplayLinkChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig);
+
+// A replaced snapshot stays readable for this long before a later Publish() frees it
+static const std::chrono::seconds k_configSnapshotGrace(10);
+
+// --------------------------------------------------------------------------
+// Purpose: RCU-style holder of the current configuration. Get() is a single
+//          atomic load, so it is safe on any hot path; Publish() swaps in a new
+//          snapshot. Instead of tracking when every reader has let go of a
+//          replaced snapshot, it is freed k_configSnapshotGrace after it was
+//          replaced, so a pointer from Get() is for use within one call and
+//          must not be kept.
+// --------------------------------------------------------------------------
+class CConfigStore
+{
+public:
+	CConfigStore() : m_pCurrent(nullptr) {}
+
+	const OptiforgeConfig_t* Get() const { return m_pCurrent.load(std::memory_order_acquire); }
+
+	// returns the snapshot that was current before, or nullptr for the first one
+	const OptiforgeConfig_t* Publish(const OptiforgeConfig_t& config);
+
+private:
+	struct RetiredSnapshot_t
+	{
+		std::unique_ptr<const OptiforgeConfig_t> pConfig;
+		std::chrono::steady_clock::time_point retiredAt;
+	};
+
+	std::atomic<const OptiforgeConfig_t*> m_pCurrent;
+
+	std::mutex m_publishMutex;
+	std::unique_ptr<const OptiforgeConfig_t> m_pOwnedCurrent;
+	std::vector<RetiredSnapshot_t> m_vecRetired;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: Re-reads the settings on a background thread whenever RequestReload()
+//          is called (from VREvent_ChangedSettings) and publishes a new snapshot
+//          if anything changed. The callback runs on that thread with the
+//          previous and the new snapshot so the owner can rebuild whatever
+//          depends on the changed values without stalling RunFrame.
+//          Run() is the thread function for CThreadRuntime, Wake() its wake
+//          callback.
+// --------------------------------------------------------------------------
+class CConfigReloader
+{
+public:
+	typedef std::function<void(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig)> ChangedCallback_t;
+
+	CConfigReloader(CConfigStore* pStore, ChangedCallback_t callback);
+
+	void Run(const CStopToken& stop);
+	void Wake();
+	void RequestReload();
+
+private:
+	CConfigStore* m_pStore;
+	ChangedCallback_t m_callback;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_bReloadRequested = false;
+};
+
+#endif // CONFIG_H
@@ -0,0 +1,279 @@
+#include "pch.h"
+#include "display_link.h"
+#include "driverlog.h"
+#include "socket_connect.h"
+#include <algorithm>
+#include <limits.h>
+#include <ws2tcpip.h>
+
+#pragma comment(lib, "ws2_32.lib")
+
+CDisplayLink::~CDisplayLink()
+{
+	Stop();
+}
+
+void CDisplayLink::Start(const DisplayLinkSettings_t& settings, SliceSink_t sink)
+{
+	Stop();
+
+	m_settings = settings;
+	if (m_settings.unWorkers == 0)
+		m_settings.unWorkers = 1;
+	m_sink = sink;
+	m_vecSlices = ComputeFrameSlices(settings.unWidth, settings.unHeight, settings.unSlicesPerEye);
+	m_unStride = settings.unWidth * k_unFrameBytesPerPixel;
+
+	// everything the frame path needs is allocated here, encoding a frame allocates nothing
+	size_t nFrameSize = (size_t)m_unStride * settings.unHeight;
+	m_vecStaging.assign(nFrameSize, 0);
+	m_vecPending.assign(nFrameSize, 0);
+	m_vecEncoding.assign(nFrameSize, 0);
+	m_vecReference.assign(nFrameSize, 0);
+
+	size_t nMaxSlice = 0;
+	for (const FrameSlice_t& slice : m_vecSlices)
+		nMaxSlice = std::max(nMaxSlice, MaxEncodedFrameSliceSize(slice.rect));
+	m_vecWorkerOutput.assign(m_settings.unWorkers, std::vector<uint8_t>(nMaxSlice));
+
+	m_bPendingValid = false;
+	m_bFrameInFlight = false;
+	m_bKeyframeRequested = true;
+	m_unFrameIndex = 0;
+	m_stats = DisplayLinkStats_t();
+
+	DriverLog("Display link: %ux%u, %u slices, %u workers, %u quantization bits\n",
+		settings.unWidth, settings.unHeight, (uint32_t)m_vecSlices.size(), m_settings.unWorkers, settings.ucQuantBits);
+
+	for (uint32_t unWorker = 0; unWorker < m_settings.unWorkers; unWorker++)
+	{
+		ThreadConfig_t threadConfig;
+		threadConfig.sName = "optiforge encode " + std::to_string(unWorker);
+		m_threads.Start(threadConfig, [this, unWorker](const CStopToken& stop) { WorkerThread(unWorker, stop); }, [this] { Wake(); });
+	}
+}
+
+void CDisplayLink::Stop()
+{
+	m_threads.StopAll();
+}
+
+void CDisplayLink::Wake()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cv.notify_all();
+}
+
+bool CDisplayLink::SubmitFrame(const uint8_t* pPixels, uint32_t unStride)
+{
+	if (m_vecStaging.empty())
+		return false;
+
+	// the copy happens outside the lock, staging belongs to the submitting thread
+	for (uint32_t y = 0; y < m_settings.unHeight; y++)
+		memcpy(&m_vecStaging[(size_t)y * m_unStride], pPixels + (size_t)y * unStride, m_unStride);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_vecStaging.swap(m_vecPending);
+	bool bReplaced = m_bPendingValid;
+	m_bPendingValid = true;
+	if (bReplaced)
+		m_stats.ulFramesReplaced++;
+
+	if (!m_bFrameInFlight)
+		BeginFrameLocked();
+	return !bReplaced;
+}
+
+void CDisplayLink::Reconnected(uint32_t unConnection)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_unConnection = unConnection;
+	m_bKeyframeRequested = true;
+}
+
+DisplayLinkStats_t CDisplayLink::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void CDisplayLink::BeginFrameLocked()
+{
+	m_vecPending.swap(m_vecEncoding);
+	m_bPendingValid = false;
+	m_bFrameInFlight = true;
+	m_bKeyframe = m_bKeyframeRequested;
+	m_bKeyframeRequested = false;
+	m_unFrameConnection = m_unConnection;
+	m_unFrameIndex++;
+	m_unNextSlice = 0;
+	m_unSlicesDone = 0;
+	m_frameStart = std::chrono::steady_clock::now();
+	m_cv.notify_all();
+}
+
+void CDisplayLink::WorkerThread(uint32_t unWorker, const CStopToken& stop)
+{
+	uint8_t* pOutput = m_vecWorkerOutput[unWorker].data();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_cv.wait(lock, [this, &stop] { return stop.StopRequested() || (m_bFrameInFlight && m_unNextSlice < m_vecSlices.size()); });
+		if (stop.StopRequested())
+			break;
+
+		uint32_t unSlice = m_unNextSlice++;
+		uint32_t unFrameIndex = m_unFrameIndex;
+		bool bKeyframe = m_bKeyframe;
+		uint32_t unConnection = m_unFrameConnection;
+		lock.unlock();
+
+		// no other worker touches this slice's rows of the reference, and the encoding
+		// buffer isn't swapped until every slice of the frame is done
+		size_t nSize = EncodeFrameSlice(m_vecEncoding.data(), m_unStride, m_vecReference.data(), m_unStride,
+			m_vecSlices[unSlice], unFrameIndex, (uint16_t)unSlice, (uint16_t)m_vecSlices.size(), m_settings.ucQuantBits, bKeyframe, pOutput);
+		bool bSent = m_sink(pOutput, nSize, unConnection);
+
+		lock.lock();
+		if (bSent)
+		{
+			m_stats.ulBytesSent += nSize;
+		}
+		else
+		{
+			// the receiver missed this slice, so its reference no longer matches ours
+			m_stats.ulSlicesDropped++;
+			m_bKeyframeRequested = true;
+		}
+
+		if (++m_unSlicesDone == m_vecSlices.size())
+		{
+			m_bFrameInFlight = false;
+			m_stats.ulFramesEncoded++;
+			m_stats.flLastFrameMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_frameStart).count();
+			if (m_bPendingValid)
+				BeginFrameLocked();
+		}
+	}
+}
+
+CDisplayLinkSender::CDisplayLinkSender(ConnectedCallback_t onConnected)
+	: m_onConnected(onConnected), m_socket(INVALID_SOCKET)
+{
+	WSADATA wsaData;
+	WSAStartup(MAKEWORD(2, 2), &wsaData);
+}
+
+CDisplayLinkSender::~CDisplayLinkSender()
+{
+	Disconnect();
+	WSACleanup();
+}
+
+void CDisplayLinkSender::Run(const CStopToken& stop, const std::string& sIP, int nPort)
+{
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((u_short)nPort);
+	inet_pton(AF_INET, sIP.c_str(), &addr.sin_addr);
+
+	bool bLoggedFailure = false;
+	while (!stop.StopRequested())
+	{
+		if (!m_bConnected)
+		{
+			// Send() only marks a failed connection, closing it is left to this thread
+			CloseSocket();
+
+			SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (sock != INVALID_SOCKET && ConnectSocket(sock, addr, &stop))
+			{
+				// slices are latency critical and already sized for the wire
+				int nNoDelay = 1;
+				setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&nNoDelay, sizeof(nNoDelay));
+
+				// a receiver that stopped reading fails the send instead of blocking the encoders
+				DWORD dwSendTimeoutMs = k_unDisplayLinkSendTimeoutMs;
+				setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char*)&dwSendTimeoutMs, sizeof(dwSendTimeoutMs));
+
+				uint32_t unConnection;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_socket = sock;
+					unConnection = ++m_unConnection;
+					m_bConnected = true;
+				}
+				DriverLog("Display link connected to %s:%d\n", sIP.c_str(), nPort);
+				bLoggedFailure = false;
+				m_onConnected(unConnection);
+			}
+			else
+			{
+				if (!bLoggedFailure)
+					DriverLog("Display link connect to %s:%d failed: %d, retrying\n", sIP.c_str(), nPort, WSAGetLastError());
+				bLoggedFailure = true;
+				if (sock != INVALID_SOCKET)
+					closesocket(sock);
+			}
+		}
+
+		stop.SleepFor(std::chrono::seconds(1));
+	}
+
+	Disconnect();
+}
+
+bool CDisplayLinkSender::Send(const uint8_t* pData, size_t nSize, uint32_t unConnection)
+{
+	// one slice at a time, slices from different workers must not interleave on the stream
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_bConnected || unConnection != m_unConnection)
+		return false;
+
+	// every send() call gives up after the socket's send timeout, this bounds a slice that
+	// a slow receiver accepts a little at a time
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(k_unDisplayLinkSendTimeoutMs);
+	while (nSize > 0)
+	{
+		int nSent = send(m_socket, (const char*)pData, (int)std::min(nSize, (size_t)INT_MAX), 0);
+		if (nSent == SOCKET_ERROR)
+		{
+			// a slice may have gone out in part, so the stream can't be continued
+			DriverLog("Display link send failed: %d, reconnecting\n", WSAGetLastError());
+			m_bConnected = false;
+			return false;
+		}
+		pData += nSent;
+		nSize -= nSent;
+
+		if (nSize > 0 && std::chrono::steady_clock::now() > deadline)
+		{
+			DriverLog("Display link receiver too slow, reconnecting\n");
+			m_bConnected = false;
+			return false;
+		}
+	}
+	return true;
+}
+
+void CDisplayLinkSender::Disconnect()
+{
+	// Only the Run() thread changes m_socket, so it can be read without the lock. Sends
+	// hold the lock for as long as they block; shutting the socket down first makes a
+	// blocked send fail right away instead of after the send timeout.
+	if (m_socket != INVALID_SOCKET)
+		shutdown(m_socket, SD_BOTH);
+	m_bConnected = false;
+	CloseSocket();
+}
+
+void CDisplayLinkSender::CloseSocket()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_socket != INVALID_SOCKET)
+		closesocket(m_socket);
+	m_socket = INVALID_SOCKET;
+}
@@ -0,0 +1,148 @@
+#ifndef DISPLAY_LINK_H
+#define DISPLAY_LINK_H
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <winsock2.h>
+#include "frame_codec.h"
+#include "thread_runtime.h"
+
+struct DisplayLinkSettings_t
+{
+	uint32_t unWidth = 0;			// side-by-side frame, i.e. the window size
+	uint32_t unHeight = 0;
+	uint32_t unSlicesPerEye = 4;
+	uint32_t unWorkers = 2;
+	uint8_t ucQuantBits = 0;		// 0 is lossless
+};
+
+struct DisplayLinkStats_t
+{
+	uint64_t ulFramesEncoded = 0;
+	uint64_t ulFramesReplaced = 0;	// submitted but overwritten by a newer frame before encoding started
+	uint64_t ulSlicesDropped = 0;	// encoded but not accepted by the sink
+	uint64_t ulBytesSent = 0;
+	float flLastFrameMs = 0.f;		// first slice picked up to last slice sent
+};
+
+// --------------------------------------------------------------------------
+// Purpose: Encodes side-by-side frames on a pool of worker threads and hands
+//          every slice to the sink as soon as it is encoded, so the first
+//          slices are on the wire while the rest are still being compressed.
+//          SubmitFrame() copies the frame and returns right away; while a
+//          frame is being encoded the newest submitted one waits, and older
+//          ones are replaced rather than queued, so the link never falls
+//          behind the renderer. SubmitFrame() is meant for one producer
+//          thread and must not race Start()/Stop().
+//          Every frame is tagged with the sink connection it was started on,
+//          as last reported to Reconnected(). Its slices only make sense to
+//          a receiver that has the frames before it, so the sink drops them
+//          once that connection is gone instead of sending them as deltas to
+//          a new receiver; the first frame started on the new connection is
+//          a keyframe.
+// --------------------------------------------------------------------------
+class CDisplayLink
+{
+public:
+	// Returns false if the slice could not be delivered on unConnection; the next frame is then sent as a keyframe
+	typedef std::function<bool(const uint8_t* pData, size_t nSize, uint32_t unConnection)> SliceSink_t;
+
+	~CDisplayLink();
+
+	void Start(const DisplayLinkSettings_t& settings, SliceSink_t sink);
+	void Stop();
+
+	// pPixels is BGRA with the size given to Start(); returns false if it replaced a frame that was never encoded
+	bool SubmitFrame(const uint8_t* pPixels, uint32_t unStride);
+
+	// The sink has a new connection: frames from now on are tagged with it and start with a keyframe
+	void Reconnected(uint32_t unConnection);
+
+	DisplayLinkStats_t GetStats();
+
+private:
+	void WorkerThread(uint32_t unWorker, const CStopToken& stop);
+	void BeginFrameLocked();
+	void Wake();
+
+	DisplayLinkSettings_t m_settings;
+	SliceSink_t m_sink;
+	std::vector<FrameSlice_t> m_vecSlices;
+	uint32_t m_unStride = 0;
+
+	// staging is written by SubmitFrame only, pending waits for the workers, encoding is read by them
+	std::vector<uint8_t> m_vecStaging;
+	std::vector<uint8_t> m_vecPending;
+	std::vector<uint8_t> m_vecEncoding;
+	std::vector<uint8_t> m_vecReference;		// what the receiver shows; every slice only touches its own rows
+	std::vector<std::vector<uint8_t>> m_vecWorkerOutput;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_bPendingValid = false;
+	bool m_bFrameInFlight = false;
+	bool m_bKeyframeRequested = true;
+	bool m_bKeyframe = false;
+	uint32_t m_unConnection = 0;
+	uint32_t m_unFrameConnection = 0;		// m_unConnection when the frame in flight began
+	uint32_t m_unFrameIndex = 0;
+	uint32_t m_unNextSlice = 0;
+	uint32_t m_unSlicesDone = 0;
+	std::chrono::steady_clock::time_point m_frameStart;
+	DisplayLinkStats_t m_stats;
+
+	CThreadRuntime m_threads;
+};
+
+// A slice that can't be sent within this long drops the connection
+static const uint32_t k_unDisplayLinkSendTimeoutMs = 500;
+
+// --------------------------------------------------------------------------
+// Purpose: TCP connection from the driver to the glasses' display receiver.
+//          Run() is a CThreadRuntime thread function that (re)connects once
+//          a second while the link is down, so encoder threads never block
+//          on a connect; Send() is called by the encoder threads and drops
+//          slices while there is no connection. Run() owns the socket: it is
+//          the only one to open or close it, Send() just marks a failed one.
+//          Every connection gets a new number, passed to the connected
+//          callback; Send() drops slices meant for an earlier one.
+//          Slices go out one at a time under the send lock so they don't
+//          interleave on the stream. A receiver that stops reading holds that
+//          lock, and with it every encoder worker, for up to
+//          k_unDisplayLinkSendTimeoutMs (less than twice that if it still
+//          drains a little), once per lost connection: the slices queued
+//          behind it find the link down and are dropped without waiting.
+// --------------------------------------------------------------------------
+class CDisplayLinkSender
+{
+public:
+	typedef std::function<void(uint32_t unConnection)> ConnectedCallback_t;
+
+	explicit CDisplayLinkSender(ConnectedCallback_t onConnected);
+	~CDisplayLinkSender();
+
+	void Run(const CStopToken& stop, const std::string& sIP, int nPort);
+	bool Send(const uint8_t* pData, size_t nSize, uint32_t unConnection);
+	bool IsConnected() const { return m_bConnected; }
+
+private:
+	void Disconnect();
+	void CloseSocket();
+
+	ConnectedCallback_t m_onConnected;
+
+	std::mutex m_mutex;
+	SOCKET m_socket;
+	uint32_t m_unConnection = 0;
+	std::atomic<bool> m_bConnected{ false };
+};
+
+#endif // DISPLAY_LINK_H
@@ -0,0 +1,25 @@
+#ifndef DISTORTION_H
+#define DISTORTION_H
+
+#pragma once
+
+#include <openvr_driver.h>
+
+// --------------------------------------------------------------------------
+// Purpose: Per-vertex lens distortion, called by the compositor for every
+//          vertex of its distortion mesh. This is an identity (pass-through)
+//          until the glasses get a real distortion model.
+// --------------------------------------------------------------------------
+inline vr::DistortionCoordinates_t ComputeLensDistortion(vr::EVREye /*eEye*/, float fU, float fV)
+{
+	vr::DistortionCoordinates_t coordinates;
+	coordinates.rfBlue[0] = fU;
+	coordinates.rfBlue[1] = fV;
+	coordinates.rfGreen[0] = fU;
+	coordinates.rfGreen[1] = fV;
+	coordinates.rfRed[0] = fU;
+	coordinates.rfRed[1] = fV;
+	return coordinates;
+}
+
+#endif // DISTORTION_H
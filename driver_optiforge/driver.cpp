@@ -1,12 +1,25 @@
 #include <openvr_driver.h>
 #include "driverlog.h"
 #include "pch.h"
+#include "shm_transport.h"
+#include "config.h"
+#include "thread_runtime.h"
+#include "render_governor.h"
+#include "pose_state.h"
+#include "pose_packet.h"
+#include "distortion.h"
+#include "display_link.h"
+#include "hand_tracking.h"
+#include "socket_connect.h"
+#include "reconnect_pacer.h"
 #include <vector>
 #include <thread>
 #include <chrono>
 #include <iostream>
 #include <winsock2.h>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
 #include <tchar.h>
 #include <ws2tcpip.h>
 
@@ -17,7 +30,10 @@
 #endif
 
 //TCP/IP settings
-const int BUFFER_SIZE = 16;
+const int BUFFER_SIZE = 64 * k_nPosePacketSize;
+
+// compositor frames fetched per RunFrame, more than enough to cover one RunFrame interval
+static const uint32_t k_unGovernorTimingBatch = 8;
 
 using namespace vr;
 
@@ -59,21 +75,6 @@ inline void HmdMatrix_SetIdentity(HmdMatrix34_t* pMatrix)
 }
 
 
-// keys for use with the settings API
-static const char* const k_pch_optiforge_Section = "driver_optiforge";
-static const char* const k_pch_optiforge_SerialNumber_String = "serialNumber";
-static const char* const k_pch_optiforge_ModelNumber_String = "modelNumber";
-static const char* const k_pch_optiforge_WindowX_Int32 = "windowX";
-static const char* const k_pch_optiforge_WindowY_Int32 = "windowY";
-static const char* const k_pch_optiforge_WindowWidth_Int32 = "windowWidth";
-static const char* const k_pch_optiforge_WindowHeight_Int32 = "windowHeight";
-static const char* const k_pch_optiforge_RenderWidth_Int32 = "renderWidth";
-static const char* const k_pch_optiforge_RenderHeight_Int32 = "renderHeight";
-static const char* const k_pch_optiforge_SecondsFromVsyncToPhotons_Float = "secondsFromVsyncToPhotons";
-static const char* const k_pch_optiforge_DisplayFrequency_Float = "displayFrequency";
-static const char* const k_pch_optiforge_IP = "ip";
-static const char* const k_pch_optiforge_Port = "port";
-
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -81,26 +82,19 @@ static const char* const k_pch_optiforge_Port = "port";
 class CWatchdogDriver_optiforge : public IVRWatchdogProvider
 {
 public:
-	CWatchdogDriver_optiforge()
-	{
-		m_pWatchdogThread = nullptr;
-	}
-
 	virtual EVRInitError Init(vr::IVRDriverContext* pDriverContext);
 	virtual void Cleanup();
 
 private:
-	std::thread* m_pWatchdogThread;
+	CThreadRuntime m_threads;
 };
 
 CWatchdogDriver_optiforge g_watchdogDriverNull;
 
 
-bool g_bExiting = false;
-
-void WatchdogThreadFunction()
+void WatchdogThreadFunction(const CStopToken& stop)
 {
-	while (!g_bExiting)
+	while (!stop.StopRequested())
 	{
 #if defined( _WINDOWS )
 		// on windows send the event when the Y key is pressed.
@@ -112,7 +106,8 @@ void WatchdogThreadFunction()
 		std::this_thread::sleep_for(std::chrono::microseconds(500));
 #else
 		// for the other platforms, just send one every five seconds
-		std::this_thread::sleep_for(std::chrono::seconds(5));
+		if (stop.SleepFor(std::chrono::seconds(5)))
+			break;
 		vr::VRWatchdogHost()->WatchdogWakeUp(vr::TrackedDeviceClass_HMD);
 #endif
 	}
@@ -126,13 +121,9 @@ EVRInitError CWatchdogDriver_optiforge::Init(vr::IVRDriverContext* pDriverContex
 	// Watchdog mode on Windows starts a thread that listens for the 'Y' key on the keyboard to 
 	// be pressed. A real driver should wait for a system button event or something else from the 
 	// the hardware that signals that the VR system should start up.
-	g_bExiting = false;
-	m_pWatchdogThread = new std::thread(WatchdogThreadFunction);
-	if (!m_pWatchdogThread)
-	{
-		DriverLog("Unable to create watchdog thread\n");
-		return VRInitError_Driver_Failed;
-	}
+	ThreadConfig_t threadConfig;
+	threadConfig.sName = "optiforge watchdog";
+	m_threads.Start(threadConfig, WatchdogThreadFunction);
 
 	return VRInitError_None;
 }
@@ -140,13 +131,7 @@ EVRInitError CWatchdogDriver_optiforge::Init(vr::IVRDriverContext* pDriverContex
 
 void CWatchdogDriver_optiforge::Cleanup()
 {
-	g_bExiting = true;
-	if (m_pWatchdogThread)
-	{
-		m_pWatchdogThread->join();
-		delete m_pWatchdogThread;
-		m_pWatchdogThread = nullptr;
-	}
+	m_threads.StopAll();
 
 	CleanupDriverLog();
 }
@@ -162,40 +147,31 @@ public:
 		m_ulPropertyContainer = vr::k_ulInvalidPropertyContainer;
 
 		DriverLog("Using settings values\n");
-		m_flIPD = vr::VRSettings()->GetFloat(k_pch_SteamVR_Section, k_pch_SteamVR_IPD_Float);
-
-		char buf[1024];
-		vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_SerialNumber_String, buf, sizeof(buf));
-		m_sSerialNumber = buf;
-
-		vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_ModelNumber_String, buf, sizeof(buf));
-		m_sModelNumber = buf;
-
-		m_nWindowX = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_WindowX_Int32);
-		m_nWindowY = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_WindowY_Int32);
-		m_nWindowWidth = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_WindowWidth_Int32);
-		m_nWindowHeight = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_WindowHeight_Int32);
-		m_nRenderWidth = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_RenderWidth_Int32);
-		m_nRenderHeight = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_RenderHeight_Int32);
-		m_flSecondsFromVsyncToPhotons = vr::VRSettings()->GetFloat(k_pch_optiforge_Section, k_pch_optiforge_SecondsFromVsyncToPhotons_Float);
-		m_flDisplayFrequency = vr::VRSettings()->GetFloat(k_pch_optiforge_Section, k_pch_optiforge_DisplayFrequency_Float);
-		PORT = vr::VRSettings()->GetInt32(k_pch_optiforge_Section, k_pch_optiforge_Port);
-
-		vr::VRSettings()->GetString(k_pch_optiforge_Section, k_pch_optiforge_IP, buf, sizeof(buf));
-		IP = buf;
-
-		DriverLog("driver_optiforge: Serial Number: %s\n", m_sSerialNumber.c_str());
-		DriverLog("driver_optiforge: Model Number: %s\n", m_sModelNumber.c_str());
-		DriverLog("driver_optiforge: Window: %d %d %d %d\n", m_nWindowX, m_nWindowY, m_nWindowWidth, m_nWindowHeight);
-		DriverLog("driver_optiforge: Render Target: %d %d\n", m_nRenderWidth, m_nRenderHeight);
-		DriverLog("driver_optiforge: Seconds from Vsync to Photons: %f\n", m_flSecondsFromVsyncToPhotons);
-		DriverLog("driver_optiforge: Display Frequency: %f\n", m_flDisplayFrequency);
-		DriverLog("driver_optiforge: IPD: %f\n", m_flIPD);
+		OptiforgeConfig_t config;
+		ReadConfigFromSettings(&config);
+		m_configStore.Publish(config);
+
+		m_sSerialNumber = config.sSerialNumber;
+
+		DriverLog("driver_optiforge: Serial Number: %s\n", config.sSerialNumber.c_str());
+		DriverLog("driver_optiforge: Model Number: %s\n", config.sModelNumber.c_str());
+		DriverLog("driver_optiforge: Window: %d %d %d %d\n", config.nWindowX, config.nWindowY, config.nWindowWidth, config.nWindowHeight);
+		DriverLog("driver_optiforge: Render Target: %d %d\n", config.nRenderWidth, config.nRenderHeight);
+		DriverLog("driver_optiforge: Seconds from Vsync to Photons: %f\n", config.flSecondsFromVsyncToPhotons);
+		DriverLog("driver_optiforge: Display Frequency: %f\n", config.flDisplayFrequency);
+		DriverLog("driver_optiforge: IPD: %f\n", config.flIPD);
+		DriverLog("driver_optiforge: Transport: %s\n", config.bUseShm ? ("shm " + config.sShmName).c_str() : "tcp");
 	}
 
 	virtual ~CoptiforgeDeviceDriver()
 	{
-		running_ = false;
+		m_threads.StopAll();
+	}
+
+	// Called from RunFrame on VREvent_ChangedSettings; the actual reload happens off the frame thread
+	void OnSettingsChanged()
+	{
+		m_configReloader.RequestReload();
 	}
 
 	virtual bool ComputeInverseDistortion(HmdVector2_t* pResult, EVREye eEye, uint32_t unChannel, float fU, float fV) override {
@@ -214,18 +190,17 @@ public:
 	virtual EVRInitError Activate(vr::TrackedDeviceIndex_t unObjectId) override
 	{
 		DriverLog("Activating device %d\n", unObjectId);
-		running_ = true;
+
+		const OptiforgeConfig_t* pConfig = m_configStore.Get();
 
 		m_unObjectId = unObjectId;
 		m_ulPropertyContainer = vr::VRProperties()->TrackedDeviceToPropertyContainer(m_unObjectId);
 
 
-		vr::VRProperties()->SetStringProperty(m_ulPropertyContainer, Prop_ModelNumber_String, m_sModelNumber.c_str());
-		vr::VRProperties()->SetStringProperty(m_ulPropertyContainer, Prop_RenderModelName_String, m_sModelNumber.c_str());
-		vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, Prop_UserIpdMeters_Float, m_flIPD);
+		vr::VRProperties()->SetStringProperty(m_ulPropertyContainer, Prop_ModelNumber_String, pConfig->sModelNumber.c_str());
+		vr::VRProperties()->SetStringProperty(m_ulPropertyContainer, Prop_RenderModelName_String, pConfig->sModelNumber.c_str());
 		vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, Prop_UserHeadToEyeDepthMeters_Float, 0.f);
-		vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, Prop_DisplayFrequency_Float, m_flDisplayFrequency);
-		vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, Prop_SecondsFromVsyncToPhotons_Float, m_flSecondsFromVsyncToPhotons);
+		SetDisplayProperties(*pConfig);
 		vr::VRProperties()->SetBoolProperty(m_ulPropertyContainer, Prop_DisplayDebugMode_Bool, true);
 
 		// return a constant that's not 0 (invalid) or 1 (reserved for Oculus)
@@ -248,29 +223,174 @@ public:
 			vr::VRProperties()->SetStringProperty(m_ulPropertyContainer, vr::Prop_NamedIconPathDeviceStandby_String, "{optiforge}/icons/headset_optiforge_status_standby.png");
 			vr::VRProperties()->SetStringProperty(m_ulPropertyContainer, vr::Prop_NamedIconPathDeviceAlertLow_String, "{optiforge}/icons/headset_optiforge_status_ready_low.png");
 		}
-		
+
+
+		if (!OpenTransport(*pConfig, nullptr)) {
+			return vr::VRInitError_Driver_Failed;
+		}
+
+		// SteamVR reads the recommended render target once, when the headset is activated,
+		// and running applications never ask again. So the scale is fixed for the session:
+		// the one the governor ended the previous session at.
+		ConfigureRenderGovernor(*pConfig);
+		float flLastScale = ReadLastRenderScale();
+		if (pConfig->bAdaptiveResolution && flLastScale > 0.f) {
+			m_renderGovernor.ResumeAt(flLastScale);
+		}
+		m_flRenderScale = pConfig->bAdaptiveResolution ? m_renderGovernor.GetScale() : 1.f;
+		DriverLog("driver_optiforge: render scale %.2f for this session\n", m_flRenderScale.load());
+
+		// The receive thread also publishes every new pose, so it gets the latency-critical settings
+		m_threads.Start(ReceiveThreadConfig(*pConfig), [this](const CStopToken& stop) { ReceiveThread(stop); });
+
+		ThreadConfig_t reloaderConfig;
+		reloaderConfig.sName = "optiforge config";
+		m_threads.Start(reloaderConfig, [this](const CStopToken& stop) { m_configReloader.Run(stop); }, [this] { m_configReloader.Wake(); });
+
+		if (pConfig->bDisplayLinkExperimental) {
+			if (pConfig->bDisplayLinkTestPattern) {
+				StartDisplayLink(*pConfig);
+			}
+			else {
+				DriverLog("Display link: no frame source besides displayLinkTestPattern yet, not starting\n");
+			}
+		}
+
+		return VRInitError_None;
+	}
+
+	// There is no compositor frame source yet (the display is a desktop window), so frames
+	// only come from the test pattern and the link stays behind displayLinkExperimental;
+	// anything that captures the eye buffers can call m_displayLink.SubmitFrame() the same way.
+	void StartDisplayLink(const OptiforgeConfig_t& config)
+	{
+		DisplayLinkSettings_t settings;
+		settings.unWidth = config.nWindowWidth;
+		settings.unHeight = config.nWindowHeight;
+		settings.unSlicesPerEye = config.unDisplayLinkSlicesPerEye;
+		settings.unWorkers = config.unDisplayLinkWorkers;
+		settings.ucQuantBits = config.ucDisplayLinkQuantBits;
+		m_displayLink.Start(settings, [this](const uint8_t* pData, size_t nSize, uint32_t unConnection) { return m_displaySender.Send(pData, nSize, unConnection); });
+
+		std::string sIP = config.sIP;
+		int nPort = config.nDisplayLinkPort;
+		ThreadConfig_t connectConfig;
+		connectConfig.sName = "optiforge display connect";
+		m_threads.Start(connectConfig, [this, sIP, nPort](const CStopToken& stop) { m_displaySender.Run(stop, sIP, nPort); });
+
+		ThreadConfig_t testConfig;
+		testConfig.sName = "optiforge test frames";
+		m_threads.Start(testConfig, [this](const CStopToken& stop) { TestFrameThread(stop); });
+	}
+
+	// Feeds synthetic frames at the display frequency, for exercising the link without a compositor
+	void TestFrameThread(const CStopToken& stop)
+	{
+		const OptiforgeConfig_t* pConfig = m_configStore.Get();
+		uint32_t unWidth = pConfig->nWindowWidth;
+		uint32_t unHeight = pConfig->nWindowHeight;
+		std::chrono::milliseconds interval((int)(1000.f / std::max(pConfig->flDisplayFrequency, 1.f)));
+
+		std::vector<uint8_t> vecFrame((size_t)unWidth * unHeight * k_unFrameBytesPerPixel);
+		uint32_t unFrame = 0;
+		std::chrono::steady_clock::time_point lastReport = std::chrono::steady_clock::now();
+
+		while (!stop.SleepFor(interval)) {
+			if (!m_displaySender.IsConnected()) {
+				continue;
+			}
+
+			FillTestFrame(vecFrame.data(), unWidth * k_unFrameBytesPerPixel, unWidth, unHeight, unFrame++);
+			m_displayLink.SubmitFrame(vecFrame.data(), unWidth * k_unFrameBytesPerPixel);
+
+			if (std::chrono::steady_clock::now() - lastReport > std::chrono::seconds(10)) {
+				lastReport = std::chrono::steady_clock::now();
+				DisplayLinkStats_t stats = m_displayLink.GetStats();
+				DriverLog("Display link: %llu frames, %llu replaced, %llu slices dropped, %.1f MB sent, last frame %.2f ms\n",
+					stats.ulFramesEncoded, stats.ulFramesReplaced, stats.ulSlicesDropped, stats.ulBytesSent / 1e6, stats.flLastFrameMs);
+			}
+		}
+	}
+
+	static ThreadConfig_t ReceiveThreadConfig(const OptiforgeConfig_t& config)
+	{
+		ThreadConfig_t threadConfig;
+		threadConfig.sName = "optiforge receive";
+		threadConfig.ulAffinityMask = config.ulReceiveThreadAffinity;
+		threadConfig.ePriority = config.eReceiveThreadPriority;
+		return threadConfig;
+	}
+
+	void SetDisplayProperties(const OptiforgeConfig_t& config)
+	{
+		vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, Prop_UserIpdMeters_Float, config.flIPD);
+		vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, Prop_DisplayFrequency_Float, config.flDisplayFrequency);
+		vr::VRProperties()->SetFloatProperty(m_ulPropertyContainer, Prop_SecondsFromVsyncToPhotons_Float, config.flSecondsFromVsyncToPhotons);
+	}
+
+	// Runs on the reloader thread
+	void OnConfigChanged(const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig)
+	{
+		if (DisplayChanged(oldConfig, newConfig) && m_ulPropertyContainer != vr::k_ulInvalidPropertyContainer) {
+			SetDisplayProperties(newConfig);
+		}
+
+		// SteamVR asks the display component for these once, when the headset is activated
+		if (DisplaySizeChanged(oldConfig, newConfig)) {
+			DriverLog("driver_optiforge: window and render sizes apply the next time the headset is activated\n");
+		}
+
+		// picked up by UpdateRenderGovernor on the RunFrame thread
+		if (RenderGovernorChanged(oldConfig, newConfig)) {
+			governorGeneration_++;
+		}
+
+		if (ThreadsChanged(oldConfig, newConfig)) {
+			m_threads.Reconfigure(ReceiveThreadConfig(newConfig));
+		}
+
+		if (DisplayLinkChanged(oldConfig, newConfig)) {
+			DriverLog("driver_optiforge: display link settings apply the next time the headset is activated\n");
+		}
+
+		if (TransportChanged(oldConfig, newConfig)) {
+			DriverLog("driver_optiforge: transport settings changed, reconnecting\n");
+			transportGeneration_++;
+		}
+	}
+
+	// pStop lets a stop cut a TCP connect short; nullptr outside of the receive thread
+	bool OpenTransport(const OptiforgeConfig_t& config, const CStopToken* pStop) {
+		m_bTransportShm = config.bUseShm;
+		if (m_bTransportShm) {
+			return m_shmTransport.Open(config.sShmName);
+		}
+
 		wsaInit_ = WSAStartup(MAKEWORD(2, 2), &wsaData_);
 		if (wsaInit_ != 0) {
 			DriverLog("WSAStartup failed: %d", wsaInit_);
 		}
-		DriverLog("WSAStartup successful\n");
-
-		if (!Connect()) {
-			return vr::VRInitError_Driver_Failed;
+		else if (!m_bLoggedConnectFailure) {
+			DriverLog("WSAStartup successful\n");
 		}
 
-		// Start the UDP thread
-		std::thread udpThread(&CoptiforgeDeviceDriver::TCPThread, this);
-		udpThread.detach(); // Detach the thread to run independently
+		return Connect(config, pStop);
+	}
 
-		return VRInitError_None;
+	void CloseTransport() {
+		if (m_bTransportShm) {
+			m_shmTransport.Close();
+			return;
+		}
+		closesocket(sock_);
+		WSACleanup();
 	}
 
-	bool Connect() {
-		timeout = 0;
+	bool Connect(const OptiforgeConfig_t& config, const CStopToken* pStop) {
+		m_packetReader.Reset();
 		serverAddr.sin_family = AF_INET;
-		serverAddr.sin_port = htons(PORT);
-		inet_pton(AF_INET, IP.c_str(), &serverAddr.sin_addr); // <-- Replace with your server's public IP
+		serverAddr.sin_port = htons(config.nPort);
+		inet_pton(AF_INET, config.sIP.c_str(), &serverAddr.sin_addr); // <-- Replace with your server's public IP
 
 		// Create UDP socket
 		sock_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
@@ -281,26 +401,43 @@ public:
 			return false;
 		}
 
-		DriverLog("Socket created successfully\n");
+		if (!m_bLoggedConnectFailure) {
+			DriverLog("Socket created successfully\n");
+		}
 
 		// Bind the socket
-		if (connect(sock_, (SOCKADDR*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
-			DriverLog("Bind failed: %d", WSAGetLastError());
+		if (!ConnectSocket(sock_, serverAddr, pStop)) {
+			// retried once a second while the sender is unreachable, so only the first attempt is logged
+			if (!m_bLoggedConnectFailure) {
+				DriverLog("Bind failed: %d, retrying\n", WSAGetLastError());
+			}
+			m_bLoggedConnectFailure = true;
 			closesocket(sock_);
 			WSACleanup();
 			return false;
 		}
+		m_bLoggedConnectFailure = false;
+		sourceAlive_ = true;
 
-		DriverLog("Listening on port %d", PORT);
+		// Wake up regularly so a transport change or Deactivate is noticed on an idle link
+		DWORD dwReceiveTimeoutMs = 100;
+		setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, (const char*)&dwReceiveTimeoutMs, sizeof(dwReceiveTimeoutMs));
+
+		DriverLog("Listening on port %d", config.nPort);
 		return true;
 	}
 
 	virtual void Deactivate() override
 	{
-		running_ = false;
+		// joins the receive thread, which closes the transport on its way out
+		m_threads.StopAll();
+		m_displayLink.Stop();
 		m_unObjectId = vr::k_unTrackedDeviceIndexInvalid;
-		closesocket(sock_);
-		WSACleanup();
+
+		// what the next session starts at
+		if (m_configStore.Get()->bAdaptiveResolution) {
+			WriteLastRenderScale(m_renderGovernor.GetScale());
+		}
 	}
 
 	virtual void EnterStandby() override
@@ -332,10 +469,11 @@ public:
 
 	virtual void GetWindowBounds(int32_t* pnX, int32_t* pnY, uint32_t* pnWidth, uint32_t* pnHeight) override
 	{
-		*pnX = m_nWindowX;
-		*pnY = m_nWindowY;
-		*pnWidth = m_nWindowWidth;
-		*pnHeight = m_nWindowHeight;
+		const OptiforgeConfig_t* pConfig = m_configStore.Get();
+		*pnX = pConfig->nWindowX;
+		*pnY = pConfig->nWindowY;
+		*pnWidth = pConfig->nWindowWidth;
+		*pnHeight = pConfig->nWindowHeight;
 	}
 
 	virtual bool IsDisplayOnDesktop() override
@@ -350,24 +488,21 @@ public:
 
 	virtual void GetRecommendedRenderTargetSize(uint32_t* pnWidth, uint32_t* pnHeight) override
 	{
-		*pnWidth = m_nRenderWidth;
-		*pnHeight = m_nRenderHeight;
+		const OptiforgeConfig_t* pConfig = m_configStore.Get();
+		float flScale = m_flRenderScale.load(std::memory_order_relaxed);
+		*pnWidth = (uint32_t)(pConfig->nRenderWidth * flScale + 0.5f);
+		*pnHeight = (uint32_t)(pConfig->nRenderHeight * flScale + 0.5f);
 	}
 
 	virtual void GetEyeOutputViewport(EVREye eEye, uint32_t* pnX, uint32_t* pnY, uint32_t* pnWidth, uint32_t* pnHeight) override
 	{
-		*pnY = 0;
-		*pnWidth = m_nWindowWidth / 2;
-		*pnHeight = m_nWindowHeight;
-
-		if (eEye == Eye_Left)
-		{
-			*pnX = 0;
-		}
-		else
-		{
-			*pnX = m_nWindowWidth / 2;
-		}
+		// shared with the display link, which slices frames along the same layout
+		const OptiforgeConfig_t* pConfig = m_configStore.Get();
+		FrameRect_t viewport = ComputeEyeOutputViewport(eEye, pConfig->nWindowWidth, pConfig->nWindowHeight);
+		*pnX = viewport.unX;
+		*pnY = viewport.unY;
+		*pnWidth = viewport.unWidth;
+		*pnHeight = viewport.unHeight;
 	}
 
 	virtual void GetProjectionRaw(EVREye eEye, float* pfLeft, float* pfRight, float* pfTop, float* pfBottom) override
@@ -380,84 +515,185 @@ public:
 
 	virtual DistortionCoordinates_t ComputeDistortion(EVREye eEye, float fU, float fV) override
 	{
-		DistortionCoordinates_t coordinates;
-		coordinates.rfBlue[0] = fU;
-		coordinates.rfBlue[1] = fV;
-		coordinates.rfGreen[0] = fU;
-		coordinates.rfGreen[1] = fV;
-		coordinates.rfRed[0] = fU;
-		coordinates.rfRed[1] = fV;
-		return coordinates;
+		return ComputeLensDistortion(eEye, fU, fV);
 	}
 
 	virtual DriverPose_t GetPose() override
 	{
-		// Let's retrieve the Hmd pose to base our controller pose off.
+		// the sample first: a clock read before it could be older than the sample's timestamp
+		PoseSample_t sample = m_poseState.Read();
+		return BuildHmdPose(sample, sourceAlive_, ShmRing_NowUs());
+	}
 
-	// First, initialize the struct that we'll be submitting to the runtime to tell it we've updated our pose.
-		vr::DriverPose_t pose = { 0 };
+	void ReceiveThread(const CStopToken& stop) {
+		bool bTransportOpen = true; // opened by Activate
+		CReconnectPacer pacer;
+		pacer.Connected(CReconnectPacer::Clock::now());
+		uint32_t unGeneration = transportGeneration_;
+
+		while (!stop.StopRequested()) {
+			if (unGeneration != transportGeneration_ || !bTransportOpen) {
+				unGeneration = transportGeneration_;
+				if (bTransportOpen) {
+					// a switched transport starts out alive, a lost TCP sender only once it's connected again
+					CloseTransport();
+					sourceAlive_ = true;
+				}
+				bTransportOpen = OpenTransport(*m_configStore.Get(), &stop);
+				if (!bTransportOpen) {
+					stop.SleepFor(pacer.DelayAfterConnectFailure());
+					continue;
+				}
+				pacer.Connected(CReconnectPacer::Clock::now());
+			}
 
-		// These need to be set to be valid quaternions. The device won't appear otherwise.
-		pose.qWorldFromDriverRotation.w = 1.f;
-		pose.qDriverFromHeadRotation.w = 1.f;
+			if (m_bTransportShm) {
+				ReceiveShm();
+			}
+			else if (!ReceiveTCP()) {
+				CloseTransport();
+				bTransportOpen = false;
+				stop.SleepFor(pacer.DelayAfterConnectionLost(CReconnectPacer::Clock::now()));
+			}
+		}
 
-		{
-			std::lock_guard<std::mutex> lock(quatMutex); // Scoped lock for thread safety
-			pose.qRotation.x = quat[0];
-			pose.qRotation.y = quat[1];
-			pose.qRotation.z = quat[2];
-			pose.qRotation.w = quat[3];
+		if (bTransportOpen) {
+			CloseTransport();
 		}
+	}
 
-		pose.vecPosition[0] = 0.0f;
-		pose.vecPosition[1] = 1.7;
-		pose.vecPosition[2] = 0.0f;
+	// Returns false once the connection is gone. The socket is useless after that, so
+	// the caller has to reconnect instead of calling this again.
+	bool ReceiveTCP() {
+		char buffer[BUFFER_SIZE];
 
-		// The pose we provided is valid.
-		// This should be set is
-		pose.poseIsValid = true;
+		// Receive data from the socket, whatever has queued up since the last call
+		int received = recv(sock_, buffer, BUFFER_SIZE, 0);
 
-		// Our device is always connected.
-		// In reality with physical devices, when they get disconnected,
-		// set this to false and icons in SteamVR will be updated to show the device is disconnected
-		pose.deviceIsConnected = true;
+		if (received == SOCKET_ERROR) {
+			int error = WSAGetLastError();
+			if (error == WSAETIMEDOUT) {
+				return true;
+			}
+			DriverLog("Receive failed: %d, reconnecting\n", error);
+		}
+		else if (received > 0) {
+			if (ReceivePoseStream(&m_packetReader, &m_poseState, buffer, received) > 0) {
+				PublishPose();
+			}
+			return true;
+		}
+		else {
+			DriverLog("Connection closed by sender, reconnecting\n");
+		}
 
-		// The state of our tracking. For our virtual device, it's always going to be ok,
-		// but this can get set differently to inform the runtime about the state of the device's tracking
-		// and update the icons to inform the user accordingly.
-		pose.result = vr::TrackingResult_Running_OK;
+		sourceAlive_ = false;
+		return false;
+	}
 
-		// For HMDs we want to apply rotation/motion prediction
-		pose.shouldApplyHeadModel = true;
+	void ReceiveShm() {
+		const ShmPoseRecord_t* pRecord = m_shmTransport.WaitForLatest(100);
+		if (pRecord) {
+			UpdatePose(pRecord->quat, pRecord->ulTimestampUs);
+			m_shmTransport.Consume();
+		}
+		sourceAlive_ = m_shmTransport.IsProducerAlive();
+	}
 
-		return pose;
+	// Pose from a transport that hands over whole samples; ulTimestampUs is 0 when it doesn't
+	// carry a sample time. The TCP stream goes through ReceivePoseStream instead.
+	void UpdatePose(const float newQuat[4], uint64_t ulTimestampUs) {
+		m_poseState.Update(newQuat, ulTimestampUs);
+		PublishPose();
 	}
 
-	void TCPThread() {
-		while (running_) {
-			char buffer[BUFFER_SIZE];
+	// Publish right away instead of waiting for the next RunFrame. m_unObjectId is stable
+	// here: it's set before this thread starts and cleared only after it has been joined.
+	void PublishPose() {
+		vr::VRServerDriverHost()->TrackedDevicePoseUpdated(m_unObjectId, GetPose(), sizeof(DriverPose_t));
+	}
 
-			// Receive data from the socket
-			int received = recv(sock_, buffer, BUFFER_SIZE, 0);
+	void ConfigureRenderGovernor(const OptiforgeConfig_t& config)
+	{
+		RenderGovernorSettings_t settings;
+		settings.flMinScale = config.flRenderScaleMin;
+		settings.flMaxScale = config.flRenderScaleMax;
+		m_renderGovernor.Configure(settings, config.flDisplayFrequency);
+	}
 
-			if (received == SOCKET_ERROR) {
-				DriverLog("Receive failed: %d", WSAGetLastError());
-				continue;
-			}
-			
-			if (received == BUFFER_SIZE) {
-				std::lock_guard<std::mutex> lock(quatMutex);  // Ensure thread safety
-				memcpy(quat, buffer, BUFFER_SIZE);
-			}
-			else {
-				if (timeout > 10) {
-					closesocket(sock_);
-					Connect();
+	// Feeds the compositor timings of all frames since the last call into the governor and
+	// the trace, if one is being recorded. Runs on the RunFrame thread, which is the only one
+	// touching m_renderGovernor and m_governorTrace besides Activate and Deactivate.
+	//
+	// Frames are rendered at m_flRenderScale all session long, so the governor is fed their
+	// timings rescaled to the scale it recommends. That keeps its model closed-loop, and the
+	// scale it ends at is what the next session renders at.
+	void UpdateRenderGovernor()
+	{
+		// Only edits to the governor's own settings get here, any other would throw away its
+		// smoothed timings and holds. Configure() keeps them for a change of the trace alone.
+		// The generation is read first: it is bumped after the snapshot it belongs to is out.
+		uint32_t unGeneration = governorGeneration_;
+		const OptiforgeConfig_t* pConfig = m_configStore.Get();
+		if (!m_bGovernorConfigured || unGeneration != m_unGovernorGeneration) {
+			m_bGovernorConfigured = true;
+			m_unGovernorGeneration = unGeneration;
+
+			ConfigureRenderGovernor(*pConfig);
+
+			if (pConfig->sRenderGovernorTrace != m_sGovernorTracePath) {
+				m_sGovernorTracePath = pConfig->sRenderGovernorTrace;
+				if (m_governorTrace.Open(m_sGovernorTracePath)) {
+					DriverLog("driver_optiforge: recording frame timings to %s\n", m_sGovernorTracePath.c_str());
+				}
+				else if (!m_sGovernorTracePath.empty()) {
+					DriverLog("driver_optiforge: unable to write frame timings to %s\n", m_sGovernorTracePath.c_str());
 				}
+			}
+		}
 
-				timeout++;
+		if (!pConfig->bAdaptiveResolution && !m_governorTrace.IsOpen()) {
+			return;
+		}
 
-				DriverLog("Unexpected data size");
+		vr::Compositor_FrameTiming timings[k_unGovernorTimingBatch] = {};
+		for (uint32_t i = 0; i < k_unGovernorTimingBatch; i++) {
+			timings[i].m_nSize = sizeof(vr::Compositor_FrameTiming);
+		}
+		if (!vr::VRServerDriverHost()->GetFrameTimings(timings, k_unGovernorTimingBatch)) {
+			return;
+		}
+
+		std::sort(timings, timings + k_unGovernorTimingBatch, [](const vr::Compositor_FrameTiming& a, const vr::Compositor_FrameTiming& b) {
+			return a.m_nFrameIndex < b.m_nFrameIndex;
+		});
+		if (timings[k_unGovernorTimingBatch - 1].m_nFrameIndex < m_unLastGovernorFrame) {
+			// the compositor restarted and its frame counter with it
+			m_unLastGovernorFrame = 0;
+		}
+
+		for (const vr::Compositor_FrameTiming& timing : timings) {
+			if (timing.m_nFrameIndex <= m_unLastGovernorFrame) {
+				continue;
+			}
+			m_unLastGovernorFrame = timing.m_nFrameIndex;
+
+			FrameTimingSample_t sample;
+			sample.unFrameIndex = timing.m_nFrameIndex;
+			// pre- and post-submit are the application's share; the compositor's own pass
+			// doesn't change with the render target, so it is passed on separately
+			sample.flGpuMs = timing.m_flPreSubmitGpuMs + timing.m_flPostSubmitGpuMs;
+			sample.flCompositorGpuMs = timing.m_flCompositorRenderGpuMs;
+			sample.flCpuMs = std::max(timing.m_flNewFrameReadyMs - timing.m_flNewPosesReadyMs, 0.f);
+			sample.unMissedFrames = timing.m_nNumDroppedFrames + (timing.m_nNumFramePresents > 1 ? timing.m_nNumFramePresents - 1 : 0);
+
+			float flRenderedScale = m_flRenderScale.load(std::memory_order_relaxed);
+			m_governorTrace.Write(flRenderedScale, sample);
+
+			if (pConfig->bAdaptiveResolution
+				&& m_renderGovernor.AddSample(RescaleFrameTimingSample(sample, flRenderedScale, m_renderGovernor.GetScale(), pConfig->flDisplayFrequency))) {
+				DriverLog("driver_optiforge: render scale for the next session %.2f (app gpu %.2f ms, compositor gpu %.2f ms, cpu %.2f ms at that scale)\n",
+					m_renderGovernor.GetScale(), m_renderGovernor.GetSmoothedGpuMs(), m_renderGovernor.GetSmoothedCompositorGpuMs(), m_renderGovernor.GetSmoothedCpuMs());
 			}
 		}
 	}
@@ -466,6 +702,8 @@ public:
 	{
 		frame_number_++;
 
+		UpdateRenderGovernor();
+
 		// In a real driver, this should happen from some pose tracking thread.
 		// The RunFrame interval is unspecified and can be very irregular if some other
 		// driver blocks it for some periodic task.
@@ -476,40 +714,51 @@ public:
 	}
 
 	std::string GetSerialNumber() const { return m_sSerialNumber; }
+	// the hands are reported relative to the head
+	const CPoseState& GetPoseState() const { return m_poseState; }
 
 private:
 	vr::TrackedDeviceIndex_t m_unObjectId;
 	vr::PropertyContainerHandle_t m_ulPropertyContainer;
 
 	std::string m_sSerialNumber;
-	std::string m_sModelNumber;
 
-	int32_t m_nWindowX;
-	int32_t m_nWindowY;
-	int32_t m_nWindowWidth;
-	int32_t m_nWindowHeight;
-	int32_t m_nRenderWidth;
-	int32_t m_nRenderHeight;
-	float m_flSecondsFromVsyncToPhotons;
-	float m_flDisplayFrequency;
-	float m_flIPD;
-
-	bool running_ = false;
+	CConfigStore m_configStore;
+	CConfigReloader m_configReloader{ &m_configStore, [this](const OptiforgeConfig_t& oldConfig, const OptiforgeConfig_t& newConfig) { OnConfigChanged(oldConfig, newConfig); } };
+	std::atomic<uint32_t> transportGeneration_{ 0 };
+
+	// the link's encoder threads send through the sender, so it has to outlive them
+	CDisplayLinkSender m_displaySender{ [this](uint32_t unConnection) { m_displayLink.Reconnected(unConnection); } };
+	CDisplayLink m_displayLink;
+
 	int frame_number_ = 0;
 
-	float quat[4] = { 0.0, 0.0, 0.0, 1.0 };
-	std::mutex quatMutex;
+	CPoseState m_poseState;
+	CPosePacketReader m_packetReader;
+	std::atomic<bool> sourceAlive_{ true };
+
+	CRenderGovernor m_renderGovernor;
+	std::atomic<uint32_t> governorGeneration_{ 0 };
+	uint32_t m_unGovernorGeneration = 0;
+	bool m_bGovernorConfigured = false;
+	uint32_t m_unLastGovernorFrame = 0;
+	std::atomic<float> m_flRenderScale{ 1.f };
+	CFrameTimingTraceWriter m_governorTrace;
+	std::string m_sGovernorTracePath;
+
+	bool m_bTransportShm = false;
+	CShmPoseTransport m_shmTransport;
 
 	WSADATA wsaData_;
 	int wsaInit_;
 	SOCKET sock_;
 
-	int PORT = 31000;
-	std::string IP;
-
 	sockaddr_in serverAddr{};
 
-	int timeout = 0;
+	bool m_bLoggedConnectFailure = false;
+
+	// last, so it is destroyed first and joins the threads while everything they touch is still alive
+	CThreadRuntime m_threads;
 };
 
 //-----------------------------------------------------------------------------
@@ -672,6 +921,8 @@ public:
 private:
 	CoptiforgeDeviceDriver* m_pNullHmdLatest = nullptr;
 	CoptiforgeControllerDriver* m_pController = nullptr;
+	CoptiforgeHandDriver* m_pHands[2] = { nullptr, nullptr };
+	CHandTrackingLink* m_pHandLink = nullptr;
 };
 
 CServerDriver_optiforge g_serverDriverNull;
@@ -688,11 +939,34 @@ EVRInitError CServerDriver_optiforge::Init(vr::IVRDriverContext* pDriverContext)
 	//m_pController = new CoptiforgeControllerDriver();
 	//vr::VRServerDriverHost()->TrackedDeviceAdded(m_pController->GetSerialNumber().c_str(), vr::TrackedDeviceClass_Controller, m_pController);
 
+	// hand tracking is read once here, adding or removing devices needs a driver restart
+	OptiforgeConfig_t config;
+	ReadConfigFromSettings(&config);
+	if (config.bHandTracking)
+	{
+		m_pHands[0] = new CoptiforgeHandDriver(vr::TrackedControllerRole_LeftHand, config.sSerialNumber + "_hand_left", &m_pNullHmdLatest->GetPoseState());
+		m_pHands[1] = new CoptiforgeHandDriver(vr::TrackedControllerRole_RightHand, config.sSerialNumber + "_hand_right", &m_pNullHmdLatest->GetPoseState());
+		for (CoptiforgeHandDriver* pHand : m_pHands)
+			vr::VRServerDriverHost()->TrackedDeviceAdded(pHand->GetSerialNumber().c_str(), vr::TrackedDeviceClass_Controller, pHand);
+
+		DriverLog("driver_optiforge: Hand tracking on port %d\n", config.nHandPort);
+		m_pHandLink = new CHandTrackingLink(m_pHands[0], m_pHands[1]);
+		m_pHandLink->Start(config);
+	}
+
 	return VRInitError_None;
 }
 
 void CServerDriver_optiforge::Cleanup()
 {
+	// the link thread logs, reads the head pose and drives the hands, so it goes first
+	delete m_pHandLink;
+	m_pHandLink = NULL;
+	for (CoptiforgeHandDriver*& pHand : m_pHands)
+	{
+		delete pHand;
+		pHand = NULL;
+	}
 	CleanupDriverLog();
 	delete m_pNullHmdLatest;
 	m_pNullHmdLatest = NULL;
@@ -713,16 +987,22 @@ void CServerDriver_optiforge::RunFrame()
 	{
 		m_pController->RunFrame();
 	}
+	*/
 
 	vr::VREvent_t vrEvent;
 	while (vr::VRServerDriverHost()->PollNextEvent(&vrEvent, sizeof(vrEvent)))
 	{
+		if (vrEvent.eventType == vr::VREvent_ChangedSettings && m_pNullHmdLatest)
+		{
+			m_pNullHmdLatest->OnSettingsChanged();
+		}
+		/*
 		if (m_pController)
 		{
 			m_pController->ProcessEvent(vrEvent);
 		}
+		*/
 	}
-	*/
 }
 
 //-----------------------------------------------------------------------------
@@ -0,0 +1,491 @@
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#pragma once
+
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <openvr_driver.h>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define FRAMECODEC_SSE2
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+#include <arm_neon.h>
+#define FRAMECODEC_NEON
+#endif
+
+// --------------------------------------------------------------------------
+// Slice codec for the display link. Frames are 32-bit BGRA in the side-by-
+// side layout of GetEyeOutputViewport and are cut into per-eye horizontal
+// slices. Each slice is split into 16x16 tiles; tiles equal to what the
+// receiver already shows are skipped, the rest are sent as the byte-wise
+// difference to it, run-length coded. With quantBits > 0 that many low bits
+// of every channel are dropped first, which keeps sensor-noise-level changes
+// from touching tiles at all.
+//
+// Encoder and decoder both keep the last reconstructed frame; a keyframe
+// clears the slice on both sides before applying the difference.
+// --------------------------------------------------------------------------
+
+static const uint32_t k_unFrameTileSize = 16;
+static const uint32_t k_unFrameBytesPerPixel = 4;
+static const uint32_t k_unFrameSliceMagic = 0x4c44464f;	// "OFDL"
+
+enum EFrameSliceFlags
+{
+	FrameSliceFlag_Keyframe = 1,
+};
+
+#pragma pack(push, 1)
+struct FrameSliceHeader_t
+{
+	uint32_t unMagic;
+	uint32_t unFrameIndex;
+	uint16_t usSlice;
+	uint16_t usSliceCount;
+	uint16_t usX;			// slice rectangle within the side-by-side frame
+	uint16_t usY;
+	uint16_t usWidth;
+	uint16_t usHeight;
+	uint8_t ucEye;
+	uint8_t ucQuantBits;	// low bits dropped from every channel, 0 is lossless
+	uint8_t ucFlags;		// EFrameSliceFlags
+	uint8_t ucReserved;
+	uint32_t unPayloadSize;	// tile bitmap plus run-length data following the header
+};
+#pragma pack(pop)
+
+struct FrameRect_t
+{
+	uint32_t unX;
+	uint32_t unY;
+	uint32_t unWidth;
+	uint32_t unHeight;
+};
+
+struct FrameSlice_t
+{
+	FrameRect_t rect;
+	vr::EVREye eEye;
+};
+
+// The per-eye layout the display component reports: left half, right half
+inline FrameRect_t ComputeEyeOutputViewport(vr::EVREye eEye, uint32_t unWindowWidth, uint32_t unWindowHeight)
+{
+	FrameRect_t rect;
+	rect.unX = eEye == vr::Eye_Left ? 0 : unWindowWidth / 2;
+	rect.unY = 0;
+	rect.unWidth = unWindowWidth / 2;
+	rect.unHeight = unWindowHeight;
+	return rect;
+}
+
+// Cuts each eye into nSlicesPerEye bands whose height is a multiple of the tile size
+inline std::vector<FrameSlice_t> ComputeFrameSlices(uint32_t unWindowWidth, uint32_t unWindowHeight, uint32_t unSlicesPerEye)
+{
+	std::vector<FrameSlice_t> vecSlices;
+	if (unSlicesPerEye == 0)
+		unSlicesPerEye = 1;
+
+	for (int nEye = vr::Eye_Left; nEye <= vr::Eye_Right; nEye++)
+	{
+		FrameRect_t viewport = ComputeEyeOutputViewport((vr::EVREye)nEye, unWindowWidth, unWindowHeight);
+		uint32_t unBand = (viewport.unHeight + unSlicesPerEye - 1) / unSlicesPerEye;
+		unBand = (unBand + k_unFrameTileSize - 1) / k_unFrameTileSize * k_unFrameTileSize;
+
+		for (uint32_t y = 0; unBand > 0 && y < viewport.unHeight; y += unBand)
+		{
+			FrameSlice_t slice;
+			slice.eEye = (vr::EVREye)nEye;
+			slice.rect.unX = viewport.unX;
+			slice.rect.unY = viewport.unY + y;
+			slice.rect.unWidth = viewport.unWidth;
+			slice.rect.unHeight = viewport.unHeight - y < unBand ? viewport.unHeight - y : unBand;
+			vecSlices.push_back(slice);
+		}
+	}
+	return vecSlices;
+}
+
+// Upper bound of one encoded slice, header included; run-length coding never more than doubles the input
+inline size_t MaxEncodedFrameSliceSize(const FrameRect_t& rect)
+{
+	size_t nTiles = ((rect.unWidth + k_unFrameTileSize - 1) / k_unFrameTileSize) * ((rect.unHeight + k_unFrameTileSize - 1) / k_unFrameTileSize);
+	return sizeof(FrameSliceHeader_t) + (nTiles + 7) / 8 + 2 * (size_t)rect.unWidth * rect.unHeight * k_unFrameBytesPerPixel;
+}
+
+namespace framecodec
+{
+
+// true if any byte of (cur & mask) differs from ref
+inline bool RowDiffers(const uint8_t* pCur, const uint8_t* pRef, uint32_t unBytes, uint8_t ucMask)
+{
+	uint32_t i = 0;
+#if defined( FRAMECODEC_SSE2 )
+	__m128i mask = _mm_set1_epi8((char)ucMask);
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 16 <= unBytes; i += 16)
+	{
+		__m128i cur = _mm_and_si128(_mm_loadu_si128((const __m128i*)(pCur + i)), mask);
+		acc = _mm_or_si128(acc, _mm_xor_si128(cur, _mm_loadu_si128((const __m128i*)(pRef + i))));
+	}
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF)
+		return true;
+#elif defined( FRAMECODEC_NEON )
+	uint8x16_t mask = vdupq_n_u8(ucMask);
+	uint8x16_t acc = vdupq_n_u8(0);
+	for (; i + 16 <= unBytes; i += 16)
+		acc = vorrq_u8(acc, veorq_u8(vandq_u8(vld1q_u8(pCur + i), mask), vld1q_u8(pRef + i)));
+	if (vmaxvq_u8(acc) != 0)
+		return true;
+#endif
+	for (; i < unBytes; i++)
+	{
+		if ((pCur[i] & ucMask) != pRef[i])
+			return true;
+	}
+	return false;
+}
+
+// pResidual = (cur & mask) - ref per byte, then ref = cur & mask
+inline void ResidualRow(const uint8_t* pCur, uint8_t* pRef, uint8_t* pResidual, uint32_t unBytes, uint8_t ucMask)
+{
+	uint32_t i = 0;
+#if defined( FRAMECODEC_SSE2 )
+	__m128i mask = _mm_set1_epi8((char)ucMask);
+	for (; i + 16 <= unBytes; i += 16)
+	{
+		__m128i cur = _mm_and_si128(_mm_loadu_si128((const __m128i*)(pCur + i)), mask);
+		__m128i ref = _mm_loadu_si128((const __m128i*)(pRef + i));
+		_mm_storeu_si128((__m128i*)(pResidual + i), _mm_sub_epi8(cur, ref));
+		_mm_storeu_si128((__m128i*)(pRef + i), cur);
+	}
+#elif defined( FRAMECODEC_NEON )
+	uint8x16_t mask = vdupq_n_u8(ucMask);
+	for (; i + 16 <= unBytes; i += 16)
+	{
+		uint8x16_t cur = vandq_u8(vld1q_u8(pCur + i), mask);
+		vst1q_u8(pResidual + i, vsubq_u8(cur, vld1q_u8(pRef + i)));
+		vst1q_u8(pRef + i, cur);
+	}
+#endif
+	for (; i < unBytes; i++)
+	{
+		uint8_t cur = pCur[i] & ucMask;
+		pResidual[i] = (uint8_t)(cur - pRef[i]);
+		pRef[i] = cur;
+	}
+}
+
+// true if the 16 bytes at p are all zero
+inline bool BlockIsZero(const uint8_t* p)
+{
+#if defined( FRAMECODEC_SSE2 )
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), _mm_setzero_si128())) == 0xFFFF;
+#elif defined( FRAMECODEC_NEON )
+	return vmaxvq_u8(vld1q_u8(p)) == 0;
+#else
+	for (int i = 0; i < 16; i++)
+	{
+		if (p[i] != 0)
+			return false;
+	}
+	return true;
+#endif
+}
+
+// --------------------------------------------------------------------------
+// Run-length stream: a control byte c < 128 stands for c + 1 zero bytes,
+// c >= 128 is followed by c - 127 literal bytes. Put() can be called with
+// consecutive pieces of the same stream.
+// --------------------------------------------------------------------------
+class CRunLengthWriter
+{
+public:
+	explicit CRunLengthWriter(uint8_t* pOut) : m_pOut(pOut) {}
+
+	void Put(const uint8_t* pData, uint32_t unSize)
+	{
+		uint32_t i = 0;
+		while (i < unSize)
+		{
+			if (!m_pLiteral && i + 16 <= unSize && BlockIsZero(pData + i))
+			{
+				m_unZeros += 16;
+				i += 16;
+				continue;
+			}
+
+			uint8_t b = pData[i];
+			// a lone zero between literals is cheaper as a literal than as its own run
+			if (b == 0 && (!m_pLiteral || i + 1 >= unSize || pData[i + 1] == 0))
+			{
+				m_pLiteral = nullptr;
+				m_unZeros++;
+			}
+			else
+			{
+				FlushZeros();
+				if (!m_pLiteral || *m_pLiteral == 255)
+				{
+					m_pLiteral = m_pOut++;
+					*m_pLiteral = 127;
+				}
+				(*m_pLiteral)++;
+				*m_pOut++ = b;
+			}
+			i++;
+		}
+	}
+
+	// Returns the end of the stream
+	uint8_t* Finish()
+	{
+		FlushZeros();
+		m_pLiteral = nullptr;
+		return m_pOut;
+	}
+
+private:
+	void FlushZeros()
+	{
+		while (m_unZeros > 0)
+		{
+			uint32_t unRun = m_unZeros < 128 ? m_unZeros : 128;
+			*m_pOut++ = (uint8_t)(unRun - 1);
+			m_unZeros -= unRun;
+		}
+	}
+
+	uint8_t* m_pOut;
+	uint8_t* m_pLiteral = nullptr;	// control byte of the literal being written
+	uint32_t m_unZeros = 0;
+};
+
+class CRunLengthReader
+{
+public:
+	CRunLengthReader(const uint8_t* pData, const uint8_t* pEnd) : m_pData(pData), m_pEnd(pEnd) {}
+
+	// Adds the next unSize bytes of the stream onto pDest; false if the stream ends early
+	bool AddTo(uint8_t* pDest, uint32_t unSize)
+	{
+		while (unSize > 0)
+		{
+			if (m_unZeros == 0 && m_unLiteral == 0)
+			{
+				if (m_pData >= m_pEnd)
+					return false;
+				uint8_t c = *m_pData++;
+				if (c < 128)
+					m_unZeros = c + 1u;
+				else
+					m_unLiteral = c - 127u;
+			}
+
+			if (m_unZeros > 0)
+			{
+				uint32_t n = m_unZeros < unSize ? m_unZeros : unSize;
+				m_unZeros -= n;
+				pDest += n;
+				unSize -= n;
+			}
+			else
+			{
+				uint32_t n = m_unLiteral < unSize ? m_unLiteral : unSize;
+				if ((size_t)(m_pEnd - m_pData) < n)
+					return false;
+				for (uint32_t i = 0; i < n; i++)
+					pDest[i] = (uint8_t)(pDest[i] + m_pData[i]);
+				m_pData += n;
+				m_unLiteral -= n;
+				pDest += n;
+				unSize -= n;
+			}
+		}
+		return true;
+	}
+
+private:
+	const uint8_t* m_pData;
+	const uint8_t* m_pEnd;
+	uint32_t m_unZeros = 0;
+	uint32_t m_unLiteral = 0;
+};
+
+} // namespace framecodec
+
+// --------------------------------------------------------------------------
+// Encodes one slice of pFrame against pReference, which holds what the
+// receiver shows and is updated to the new contents. Both frames use the
+// full side-by-side layout. pOut must hold MaxEncodedFrameSliceSize(rect)
+// bytes; returns the number of bytes written.
+// --------------------------------------------------------------------------
+inline size_t EncodeFrameSlice(const uint8_t* pFrame, uint32_t unFrameStride, uint8_t* pReference, uint32_t unReferenceStride,
+	const FrameSlice_t& slice, uint32_t unFrameIndex, uint16_t usSlice, uint16_t usSliceCount, uint8_t ucQuantBits, bool bKeyframe, uint8_t* pOut)
+{
+	const FrameRect_t& rect = slice.rect;
+	uint8_t ucMask = (uint8_t)(0xFF << ucQuantBits);
+	uint32_t unTilesX = (rect.unWidth + k_unFrameTileSize - 1) / k_unFrameTileSize;
+	uint32_t unTilesY = (rect.unHeight + k_unFrameTileSize - 1) / k_unFrameTileSize;
+
+	if (bKeyframe)
+	{
+		for (uint32_t y = 0; y < rect.unHeight; y++)
+			memset(pReference + (size_t)(rect.unY + y) * unReferenceStride + rect.unX * k_unFrameBytesPerPixel, 0, rect.unWidth * k_unFrameBytesPerPixel);
+	}
+
+	FrameSliceHeader_t* pHeader = (FrameSliceHeader_t*)pOut;
+	uint8_t* pBitmap = pOut + sizeof(FrameSliceHeader_t);
+	size_t nBitmapSize = (unTilesX * unTilesY + 7) / 8;
+	memset(pBitmap, 0, nBitmapSize);
+
+	framecodec::CRunLengthWriter writer(pBitmap + nBitmapSize);
+	uint8_t residual[k_unFrameTileSize * k_unFrameBytesPerPixel];
+
+	for (uint32_t ty = 0; ty < unTilesY; ty++)
+	{
+		uint32_t y0 = rect.unY + ty * k_unFrameTileSize;
+		uint32_t unRows = rect.unY + rect.unHeight - y0 < k_unFrameTileSize ? rect.unY + rect.unHeight - y0 : k_unFrameTileSize;
+
+		for (uint32_t tx = 0; tx < unTilesX; tx++)
+		{
+			uint32_t x0 = rect.unX + tx * k_unFrameTileSize;
+			uint32_t unColumns = rect.unX + rect.unWidth - x0 < k_unFrameTileSize ? rect.unX + rect.unWidth - x0 : k_unFrameTileSize;
+			uint32_t unRowBytes = unColumns * k_unFrameBytesPerPixel;
+
+			const uint8_t* pCur = pFrame + (size_t)y0 * unFrameStride + x0 * k_unFrameBytesPerPixel;
+			uint8_t* pRef = pReference + (size_t)y0 * unReferenceStride + x0 * k_unFrameBytesPerPixel;
+
+			bool bChanged = bKeyframe;
+			for (uint32_t r = 0; r < unRows && !bChanged; r++)
+				bChanged = framecodec::RowDiffers(pCur + (size_t)r * unFrameStride, pRef + (size_t)r * unReferenceStride, unRowBytes, ucMask);
+			if (!bChanged)
+				continue;
+
+			uint32_t unTile = ty * unTilesX + tx;
+			pBitmap[unTile / 8] |= (uint8_t)(1 << (unTile % 8));
+			for (uint32_t r = 0; r < unRows; r++)
+			{
+				framecodec::ResidualRow(pCur + (size_t)r * unFrameStride, pRef + (size_t)r * unReferenceStride, residual, unRowBytes, ucMask);
+				writer.Put(residual, unRowBytes);
+			}
+		}
+	}
+
+	uint8_t* pEnd = writer.Finish();
+
+	pHeader->unMagic = k_unFrameSliceMagic;
+	pHeader->unFrameIndex = unFrameIndex;
+	pHeader->usSlice = usSlice;
+	pHeader->usSliceCount = usSliceCount;
+	pHeader->usX = (uint16_t)rect.unX;
+	pHeader->usY = (uint16_t)rect.unY;
+	pHeader->usWidth = (uint16_t)rect.unWidth;
+	pHeader->usHeight = (uint16_t)rect.unHeight;
+	pHeader->ucEye = (uint8_t)slice.eEye;
+	pHeader->ucQuantBits = ucQuantBits;
+	pHeader->ucFlags = bKeyframe ? FrameSliceFlag_Keyframe : 0;
+	pHeader->ucReserved = 0;
+	pHeader->unPayloadSize = (uint32_t)(pEnd - pBitmap);
+	return pEnd - pOut;
+}
+
+// --------------------------------------------------------------------------
+// Applies one encoded slice to pFrame, which holds the previously decoded
+// frame of unWidth x unHeight pixels. This is the receiver's half, kept
+// here so both sides of the format live in one place.
+// --------------------------------------------------------------------------
+inline bool DecodeFrameSlice(const uint8_t* pData, size_t nSize, uint8_t* pFrame, uint32_t unStride, uint32_t unWidth, uint32_t unHeight)
+{
+	if (nSize < sizeof(FrameSliceHeader_t))
+		return false;
+
+	FrameSliceHeader_t header;
+	memcpy(&header, pData, sizeof(header));
+	if (header.unMagic != k_unFrameSliceMagic || header.unPayloadSize > nSize - sizeof(header)
+		|| (uint32_t)header.usX + header.usWidth > unWidth || (uint32_t)header.usY + header.usHeight > unHeight)
+		return false;
+
+	uint32_t unTilesX = (header.usWidth + k_unFrameTileSize - 1) / k_unFrameTileSize;
+	uint32_t unTilesY = (header.usHeight + k_unFrameTileSize - 1) / k_unFrameTileSize;
+	size_t nBitmapSize = (unTilesX * unTilesY + 7) / 8;
+	if (nBitmapSize > header.unPayloadSize)
+		return false;
+
+	if (header.ucFlags & FrameSliceFlag_Keyframe)
+	{
+		for (uint32_t y = 0; y < header.usHeight; y++)
+			memset(pFrame + (size_t)(header.usY + y) * unStride + header.usX * k_unFrameBytesPerPixel, 0, header.usWidth * k_unFrameBytesPerPixel);
+	}
+
+	const uint8_t* pBitmap = pData + sizeof(header);
+	framecodec::CRunLengthReader reader(pBitmap + nBitmapSize, pBitmap + header.unPayloadSize);
+
+	for (uint32_t ty = 0; ty < unTilesY; ty++)
+	{
+		uint32_t y0 = header.usY + ty * k_unFrameTileSize;
+		uint32_t unRows = header.usY + header.usHeight - y0 < k_unFrameTileSize ? header.usY + header.usHeight - y0 : k_unFrameTileSize;
+
+		for (uint32_t tx = 0; tx < unTilesX; tx++)
+		{
+			uint32_t unTile = ty * unTilesX + tx;
+			if (!(pBitmap[unTile / 8] & (1 << (unTile % 8))))
+				continue;
+
+			uint32_t x0 = header.usX + tx * k_unFrameTileSize;
+			uint32_t unColumns = header.usX + header.usWidth - x0 < k_unFrameTileSize ? header.usX + header.usWidth - x0 : k_unFrameTileSize;
+			for (uint32_t r = 0; r < unRows; r++)
+			{
+				if (!reader.AddTo(pFrame + (size_t)(y0 + r) * unStride + x0 * k_unFrameBytesPerPixel, unColumns * k_unFrameBytesPerPixel))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+// --------------------------------------------------------------------------
+// Synthetic frames for running the display link without a compositor: a
+// static gradient per eye, a square that moves every frame and a strip of
+// per-frame noise, roughly what a mostly static scene with some motion and
+// an animated HUD element looks like to the tile diff.
+// --------------------------------------------------------------------------
+inline void FillTestFrame(uint8_t* pFrame, uint32_t unStride, uint32_t unWidth, uint32_t unHeight, uint32_t unFrameIndex)
+{
+	uint32_t unSquare = unHeight / 8;
+	uint32_t unSquareX = (unFrameIndex * 7) % (unWidth > unSquare ? unWidth - unSquare : 1);
+	uint32_t unSquareY = unHeight / 3;
+	uint32_t unNoiseY = unHeight - unHeight / 16;
+
+	for (uint32_t y = 0; y < unHeight; y++)
+	{
+		uint8_t* pRow = pFrame + (size_t)y * unStride;
+		for (uint32_t x = 0; x < unWidth; x++)
+		{
+			uint8_t* p = pRow + x * k_unFrameBytesPerPixel;
+			p[0] = (uint8_t)(x * 255 / (unWidth ? unWidth : 1));
+			p[1] = (uint8_t)(y * 255 / (unHeight ? unHeight : 1));
+			p[2] = (uint8_t)(x < unWidth / 2 ? 64 : 192);
+			p[3] = 255;
+
+			if (x >= unSquareX && x < unSquareX + unSquare && y >= unSquareY && y < unSquareY + unSquare)
+			{
+				p[0] = 255;
+				p[1] = 255;
+				p[2] = 255;
+			}
+			else if (y >= unNoiseY && x < unWidth / 4)
+			{
+				uint32_t h = (x * 73856093u) ^ (y * 19349663u) ^ (unFrameIndex * 83492791u);
+				p[0] = (uint8_t)h;
+				p[1] = (uint8_t)(h >> 8);
+				p[2] = (uint8_t)(h >> 16);
+			}
+		}
+	}
+}
+
+#endif // FRAME_CODEC_H
@@ -0,0 +1,127 @@
+#ifndef HAND_PACKET_H
+#define HAND_PACKET_H
+
+#pragma once
+
+#include <string.h>
+#include <stdint.h>
+
+// Bones of the SteamVR hand skeleton, root and wrist included
+static const uint32_t k_unHandBoneCount = 31;
+static const uint32_t k_unHandMessageMagic = 0x5448464f;	// "OFHT"
+
+enum EHandMessageType
+{
+	HandMessage_Calibration = 1,
+	HandMessage_Frame = 2,
+};
+
+enum EHandFrameFlags
+{
+	HandFrameFlag_Tracked = 1,
+};
+
+// --------------------------------------------------------------------------
+// Hand tracking stream, little-endian. Every message is a header followed by
+// usPayloadSize bytes. A calibration carries the bind pose bone offsets and
+// is sent on connect and whenever the tracker re-measures the hand; frames
+// only carry rotations, packed with posemath::EncodeSmallestThree.
+// Positions and rotations are in the SteamVR skeleton convention: each bone
+// relative to its parent, the wrist relative to the head, in meters.
+// --------------------------------------------------------------------------
+#pragma pack(push, 1)
+struct HandMessageHeader_t
+{
+	uint32_t unMagic;
+	uint8_t ucType;			// EHandMessageType
+	uint8_t ucHand;			// 0 left, 1 right
+	uint16_t usPayloadSize;
+};
+
+struct HandCalibration_t
+{
+	float bonePositions[k_unHandBoneCount][3];
+};
+
+struct HandFrame_t
+{
+	uint32_t unSequence;
+	uint8_t ucFlags;		// EHandFrameFlags
+	uint8_t ucReserved;
+	uint16_t usCaptureAge;	// camera exposure to send in 100 us units, 0 if the sender doesn't know
+	float wristPosition[3];
+	uint32_t unWristRotation;
+	uint32_t unBoneRotations[k_unHandBoneCount];
+};
+#pragma pack(pop)
+
+// The wire format; a framed frame message is the 8-byte header plus these 148 bytes
+static_assert(sizeof(HandMessageHeader_t) == 8, "HandMessageHeader_t is part of the wire format");
+static_assert(sizeof(HandFrame_t) == 148, "HandFrame_t is part of the wire format");
+
+// --------------------------------------------------------------------------
+// Purpose: Cuts the TCP byte stream back into hand messages. A header with
+//          the wrong magic or a size that doesn't match its type is skipped
+//          a byte at a time until the stream lines up again.
+// --------------------------------------------------------------------------
+class CHandMessageReader
+{
+public:
+	void Reset() { m_nBuffered = 0; }
+
+	// Calls handler(header, pPayload) for every message completed by pData
+	template <typename Handler>
+	void Feed(const char* pData, int nSize, Handler handler)
+	{
+		while (nSize > 0)
+		{
+			int nTake = (int)sizeof(m_buffer) - m_nBuffered;
+			if (nTake > nSize)
+				nTake = nSize;
+			memcpy(m_buffer + m_nBuffered, pData, nTake);
+			m_nBuffered += nTake;
+			pData += nTake;
+			nSize -= nTake;
+
+			int nOffset = 0;
+			while (m_nBuffered - nOffset >= (int)sizeof(HandMessageHeader_t))
+			{
+				HandMessageHeader_t header;
+				memcpy(&header, m_buffer + nOffset, sizeof(header));
+				if (!IsValidHeader(header))
+				{
+					nOffset++;
+					continue;
+				}
+
+				int nMessageSize = (int)sizeof(header) + header.usPayloadSize;
+				if (m_nBuffered - nOffset < nMessageSize)
+					break;
+
+				handler(header, m_buffer + nOffset + sizeof(header));
+				nOffset += nMessageSize;
+			}
+
+			m_nBuffered -= nOffset;
+			memmove(m_buffer, m_buffer + nOffset, m_nBuffered);
+		}
+	}
+
+private:
+	static bool IsValidHeader(const HandMessageHeader_t& header)
+	{
+		if (header.unMagic != k_unHandMessageMagic || header.ucHand > 1)
+			return false;
+		if (header.ucType == HandMessage_Calibration)
+			return header.usPayloadSize == sizeof(HandCalibration_t);
+		if (header.ucType == HandMessage_Frame)
+			return header.usPayloadSize == sizeof(HandFrame_t);
+		return false;
+	}
+
+	// room for a few frames, and always for the largest message
+	alignas(4) uint8_t m_buffer[4 * (sizeof(HandMessageHeader_t) + sizeof(HandCalibration_t))];
+	int m_nBuffered = 0;
+};
+
+#endif // HAND_PACKET_H
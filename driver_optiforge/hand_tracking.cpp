@@ -0,0 +1,266 @@
+#include "pch.h"
+#include "hand_tracking.h"
+#include "driverlog.h"
+#include "pose_math.h"
+#include "socket_connect.h"
+#include "reconnect_pacer.h"
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#pragma comment(lib, "ws2_32.lib")
+
+CoptiforgeHandDriver::CoptiforgeHandDriver(vr::ETrackedControllerRole eRole, const std::string& sSerialNumber, const CPoseState* pHeadPose)
+	: m_eRole(eRole), m_sSerialNumber(sSerialNumber), m_pHeadPose(pHeadPose), m_unObjectId(vr::k_unTrackedDeviceIndexInvalid)
+{
+	m_ulPropertyContainer = vr::k_ulInvalidPropertyContainer;
+	m_ulSkeleton = vr::k_ulInvalidInputComponentHandle;
+
+	memset(m_boneTransforms, 0, sizeof(m_boneTransforms));
+	for (vr::VRBoneTransform_t& bone : m_boneTransforms)
+	{
+		bone.position.v[3] = 1.f;
+		bone.orientation.w = 1.f;
+	}
+
+	memset(&m_pose, 0, sizeof(m_pose));
+	m_pose.qWorldFromDriverRotation.w = 1.f;
+	m_pose.qDriverFromHeadRotation.w = 1.f;
+	m_pose.qRotation.w = 1.f;
+	m_pose.result = vr::TrackingResult_Calibrating_OutOfRange;
+}
+
+vr::EVRInitError CoptiforgeHandDriver::Activate(vr::TrackedDeviceIndex_t unObjectId)
+{
+	bool bLeft = m_eRole == vr::TrackedControllerRole_LeftHand;
+	m_ulPropertyContainer = vr::VRProperties()->TrackedDeviceToPropertyContainer(unObjectId);
+
+	vr::VRProperties()->SetStringProperty(m_ulPropertyContainer, vr::Prop_ModelNumber_String, bLeft ? "optiforge hand left" : "optiforge hand right");
+	vr::VRProperties()->SetStringProperty(m_ulPropertyContainer, vr::Prop_ControllerType_String, "optiforge_hand");
+	vr::VRProperties()->SetInt32Property(m_ulPropertyContainer, vr::Prop_ControllerRoleHint_Int32, m_eRole);
+	vr::VRProperties()->SetStringProperty(m_ulPropertyContainer, vr::Prop_InputProfilePath_String, "{optiforge}/input/optiforge_hand_profile.json");
+
+	// return a constant that's not 0 (invalid) or 1 (reserved for Oculus)
+	vr::VRProperties()->SetUint64Property(m_ulPropertyContainer, vr::Prop_CurrentUniverseId_Uint64, 2);
+
+	vr::EVRInputError eError = vr::VRDriverInput()->CreateSkeletonComponent(m_ulPropertyContainer,
+		bLeft ? "/input/skeleton/left" : "/input/skeleton/right",
+		bLeft ? "/skeleton/hand/left" : "/skeleton/hand/right",
+		"/pose/raw", vr::VRSkeletalTracking_Full, nullptr, 0, &m_ulSkeleton);
+	if (eError != vr::VRInputError_None)
+	{
+		DriverLog("Hand %s: CreateSkeletonComponent failed: %d\n", m_sSerialNumber.c_str(), eError);
+		return vr::VRInitError_Driver_Failed;
+	}
+
+	m_bSkeletonReady = true;
+	m_unObjectId = unObjectId;
+	return vr::VRInitError_None;
+}
+
+void CoptiforgeHandDriver::Deactivate()
+{
+	// the link thread may still deliver frames; it checks both of these first
+	m_unObjectId = vr::k_unTrackedDeviceIndexInvalid;
+	m_bSkeletonReady = false;
+}
+
+void CoptiforgeHandDriver::DebugRequest(const char* pchRequest, char* pchResponseBuffer, uint32_t unResponseBufferSize)
+{
+	if (unResponseBufferSize >= 1)
+		pchResponseBuffer[0] = 0;
+}
+
+vr::DriverPose_t CoptiforgeHandDriver::GetPose()
+{
+	std::lock_guard<std::mutex> lock(m_poseMutex);
+	return m_pose;
+}
+
+void CoptiforgeHandDriver::OnCalibration(const HandCalibration_t& calibration)
+{
+	// bone offsets only change with a new calibration, frames just rotate the bones
+	for (uint32_t i = 0; i < k_unHandBoneCount; i++)
+	{
+		m_boneTransforms[i].position.v[0] = calibration.bonePositions[i][0];
+		m_boneTransforms[i].position.v[1] = calibration.bonePositions[i][1];
+		m_boneTransforms[i].position.v[2] = calibration.bonePositions[i][2];
+		m_boneTransforms[i].position.v[3] = 1.f;
+	}
+
+	if (!m_bCalibrated)
+		DriverLog("Hand %s: calibrated\n", m_sSerialNumber.c_str());
+	m_bCalibrated = true;
+}
+
+void CoptiforgeHandDriver::OnFrame(const HandFrame_t& frame)
+{
+	bool bTracked = (frame.ucFlags & HandFrameFlag_Tracked) != 0 && m_bCalibrated;
+
+	// The wrist is relative to the head at capture time, so the HMD pose of that moment, both its
+	// rotation and its position from the same sample, becomes the driver-to-world transform. Head poses are looked up by when they arrived, on the
+	// assumption that both streams take about as long to get here from the glasses. Senders
+	// that leave usCaptureAge at 0 get the newest head pose, and their hands trail head turns
+	// by the camera latency.
+	PoseSample_t headSample = frame.usCaptureAge != 0
+		? m_pHeadPose->ReadArrivedBy(CPoseState::ArrivalNowUs() - frame.usCaptureAge * 100ull)
+		: m_pHeadPose->Read();
+	vr::DriverPose_t headPose = BuildHmdPose(headSample, true, 0);
+
+	vr::DriverPose_t pose;
+	memset(&pose, 0, sizeof(pose));
+	pose.qWorldFromDriverRotation = headPose.qRotation;
+	pose.vecWorldFromDriverTranslation[0] = headSample.position[0];
+	pose.vecWorldFromDriverTranslation[1] = headSample.position[1];
+	pose.vecWorldFromDriverTranslation[2] = headSample.position[2];
+	pose.qDriverFromHeadRotation.w = 1.f;
+	pose.qRotation = posemath::ToHmdQuaternion(posemath::DecodeSmallestThree(frame.unWristRotation));
+	pose.vecPosition[0] = frame.wristPosition[0];
+	pose.vecPosition[1] = frame.wristPosition[1];
+	pose.vecPosition[2] = frame.wristPosition[2];
+	pose.poseIsValid = bTracked;
+	pose.result = bTracked ? vr::TrackingResult_Running_OK : vr::TrackingResult_Running_OutOfRange;
+	pose.deviceIsConnected = true;
+
+	if (bTracked)
+	{
+		posemath::QuatArray_t rotations = { m_boneRotations[0], m_boneRotations[1], m_boneRotations[2], m_boneRotations[3] };
+		posemath::DecodeSmallestThreeBatch(frame.unBoneRotations, rotations, k_unHandBoneCount);
+		for (uint32_t i = 0; i < k_unHandBoneCount; i++)
+		{
+			m_boneTransforms[i].orientation.w = m_boneRotations[0][i];
+			m_boneTransforms[i].orientation.x = m_boneRotations[1][i];
+			m_boneTransforms[i].orientation.y = m_boneRotations[2][i];
+			m_boneTransforms[i].orientation.z = m_boneRotations[3][i];
+		}
+
+		if (m_bSkeletonReady)
+		{
+			// There is no controller in the hand to bend around, so both ranges get the tracked
+			// hand as is; applications asking for either one see the real fingers.
+			vr::VRDriverInput()->UpdateSkeletonComponent(m_ulSkeleton, vr::VRSkeletalMotionRange_WithoutController, m_boneTransforms, k_unHandBoneCount);
+			vr::VRDriverInput()->UpdateSkeletonComponent(m_ulSkeleton, vr::VRSkeletalMotionRange_WithController, m_boneTransforms, k_unHandBoneCount);
+		}
+	}
+
+	PublishPose(pose);
+}
+
+void CoptiforgeHandDriver::OnDisconnected()
+{
+	vr::DriverPose_t pose = GetPose();
+	pose.poseIsValid = false;
+	pose.deviceIsConnected = false;
+	pose.result = vr::TrackingResult_Running_OutOfRange;
+	PublishPose(pose);
+}
+
+void CoptiforgeHandDriver::PublishPose(const vr::DriverPose_t& pose)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_poseMutex);
+		m_pose = pose;
+	}
+
+	vr::TrackedDeviceIndex_t unObjectId = m_unObjectId;
+	if (unObjectId != vr::k_unTrackedDeviceIndexInvalid)
+		vr::VRServerDriverHost()->TrackedDevicePoseUpdated(unObjectId, pose, sizeof(vr::DriverPose_t));
+}
+
+CHandTrackingLink::CHandTrackingLink(CoptiforgeHandDriver* pLeft, CoptiforgeHandDriver* pRight)
+{
+	m_pHands[0] = pLeft;
+	m_pHands[1] = pRight;
+}
+
+void CHandTrackingLink::Start(const OptiforgeConfig_t& config)
+{
+	// the same latency-critical settings as the pose receive thread
+	ThreadConfig_t threadConfig;
+	threadConfig.sName = "optiforge hands";
+	threadConfig.ulAffinityMask = config.ulReceiveThreadAffinity;
+	threadConfig.ePriority = config.eReceiveThreadPriority;
+
+	std::string sIP = config.sIP;
+	int nPort = config.nHandPort;
+	m_threads.Start(threadConfig, [this, sIP, nPort](const CStopToken& stop) { ReceiveThread(stop, sIP, nPort); });
+}
+
+void CHandTrackingLink::Stop()
+{
+	m_threads.StopAll();
+}
+
+void CHandTrackingLink::ReceiveThread(const CStopToken& stop, const std::string& sIP, int nPort)
+{
+	WSADATA wsaData;
+	WSAStartup(MAKEWORD(2, 2), &wsaData);
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((u_short)nPort);
+	inet_pton(AF_INET, sIP.c_str(), &addr.sin_addr);
+
+	char buffer[4096];
+	bool bLoggedFailure = false;
+	CReconnectPacer pacer;
+
+	while (!stop.StopRequested())
+	{
+		SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (sock == INVALID_SOCKET || !ConnectSocket(sock, addr, &stop))
+		{
+			// one line per outage instead of one per attempt
+			if (!bLoggedFailure)
+				DriverLog("Hand tracking: connect to %s:%d failed: %d, retrying\n", sIP.c_str(), nPort, WSAGetLastError());
+			bLoggedFailure = true;
+			if (sock != INVALID_SOCKET)
+				closesocket(sock);
+			stop.SleepFor(pacer.DelayAfterConnectFailure());
+			continue;
+		}
+
+		DriverLog("Hand tracking: connected to %s:%d\n", sIP.c_str(), nPort);
+		bLoggedFailure = false;
+		pacer.Connected(CReconnectPacer::Clock::now());
+
+		// wake up regularly so a stop is noticed on an idle link
+		DWORD dwReceiveTimeoutMs = 100;
+		setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&dwReceiveTimeoutMs, sizeof(dwReceiveTimeoutMs));
+		m_reader.Reset();
+
+		while (!stop.StopRequested())
+		{
+			int received = recv(sock, buffer, sizeof(buffer), 0);
+			if (received == SOCKET_ERROR && WSAGetLastError() == WSAETIMEDOUT)
+				continue;
+			if (received <= 0)
+			{
+				DriverLog("Hand tracking: connection lost: %d\n", received == 0 ? 0 : WSAGetLastError());
+				break;
+			}
+
+			m_reader.Feed(buffer, received, [this](const HandMessageHeader_t& header, const uint8_t* pPayload) {
+				CoptiforgeHandDriver* pHand = m_pHands[header.ucHand];
+				if (header.ucType == HandMessage_Calibration)
+				{
+					memcpy(&m_calibration, pPayload, sizeof(m_calibration));
+					pHand->OnCalibration(m_calibration);
+				}
+				else
+				{
+					memcpy(&m_frame, pPayload, sizeof(m_frame));
+					pHand->OnFrame(m_frame);
+				}
+			});
+		}
+
+		closesocket(sock);
+		m_pHands[0]->OnDisconnected();
+		m_pHands[1]->OnDisconnected();
+
+		stop.SleepFor(pacer.DelayAfterConnectionLost(CReconnectPacer::Clock::now()));
+	}
+
+	WSACleanup();
+}
@@ -0,0 +1,86 @@
+#ifndef HAND_TRACKING_H
+#define HAND_TRACKING_H
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <openvr_driver.h>
+#include "config.h"
+#include "hand_packet.h"
+#include "pose_state.h"
+#include "thread_runtime.h"
+
+// --------------------------------------------------------------------------
+// Purpose: One camera-tracked hand. Its pose is reported relative to the
+//          head, so it follows the HMD orientation from pHeadPose, and its
+//          fingers go through a skeleton component. Everything a frame
+//          touches is a member, so updates allocate nothing.
+// --------------------------------------------------------------------------
+class CoptiforgeHandDriver : public vr::ITrackedDeviceServerDriver
+{
+public:
+	CoptiforgeHandDriver(vr::ETrackedControllerRole eRole, const std::string& sSerialNumber, const CPoseState* pHeadPose);
+	virtual ~CoptiforgeHandDriver() {}
+
+	virtual vr::EVRInitError Activate(vr::TrackedDeviceIndex_t unObjectId) override;
+	virtual void Deactivate() override;
+	virtual void EnterStandby() override {}
+	virtual void* GetComponent(const char* pchComponentNameAndVersion) override { return NULL; }
+	virtual void DebugRequest(const char* pchRequest, char* pchResponseBuffer, uint32_t unResponseBufferSize) override;
+	virtual vr::DriverPose_t GetPose() override;
+
+	std::string GetSerialNumber() const { return m_sSerialNumber; }
+
+	// called on the hand link thread
+	void OnCalibration(const HandCalibration_t& calibration);
+	void OnFrame(const HandFrame_t& frame);
+	void OnDisconnected();
+
+private:
+	void PublishPose(const vr::DriverPose_t& pose);
+
+	vr::ETrackedControllerRole m_eRole;
+	std::string m_sSerialNumber;
+	const CPoseState* m_pHeadPose;
+
+	std::atomic<vr::TrackedDeviceIndex_t> m_unObjectId;
+	vr::PropertyContainerHandle_t m_ulPropertyContainer;
+	vr::VRInputComponentHandle_t m_ulSkeleton;
+	std::atomic<bool> m_bSkeletonReady{ false };
+
+	// written and read only on the hand link thread
+	bool m_bCalibrated = false;
+	vr::VRBoneTransform_t m_boneTransforms[k_unHandBoneCount];
+	float m_boneRotations[4][k_unHandBoneCount];	// w, x, y, z
+
+	std::mutex m_poseMutex;
+	vr::DriverPose_t m_pose;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: Receives the hand tracking stream from ip:handPort and hands its
+//          messages to the two hand devices, reconnecting once a second
+//          while the glasses aren't reachable.
+// --------------------------------------------------------------------------
+class CHandTrackingLink
+{
+public:
+	CHandTrackingLink(CoptiforgeHandDriver* pLeft, CoptiforgeHandDriver* pRight);
+
+	void Start(const OptiforgeConfig_t& config);
+	void Stop();
+
+private:
+	void ReceiveThread(const CStopToken& stop, const std::string& sIP, int nPort);
+
+	CoptiforgeHandDriver* m_pHands[2];
+	CHandMessageReader m_reader;
+	HandCalibration_t m_calibration;
+	HandFrame_t m_frame;
+
+	CThreadRuntime m_threads;
+};
+
+#endif // HAND_TRACKING_H
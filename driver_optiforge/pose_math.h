@@ -0,0 +1,630 @@
+#ifndef POSE_MATH_H
+#define POSE_MATH_H
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <openvr_driver.h>
+
+#if defined( __AVX__ )
+#include <immintrin.h>
+#define POSEMATH_AVX
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define POSEMATH_SSE
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+#include <arm_neon.h>
+#define POSEMATH_NEON
+#endif
+
+// --------------------------------------------------------------------------
+// Quaternion and pose math shared by everything that filters, predicts or
+// converts poses.
+//
+// The scalar functions are the reference implementation. The *Batch
+// functions run the same operations over arrays in structure-of-arrays
+// layout with SSE, AVX or NEON, whichever the compiler targets, and fall
+// back to one lane at a time otherwise. Quaternions are (w, x, y, z) with
+// w the real part, like HmdQuaternion_t; Log/Exp use the half-angle
+// convention, so Exp(Log(q)) == q and |Log(q)| is half the rotation angle.
+// --------------------------------------------------------------------------
+namespace posemath
+{
+
+struct Quatf
+{
+	float w, x, y, z;
+};
+
+struct Vec3f
+{
+	float x, y, z;
+};
+
+constexpr Quatf Quat(float w, float x, float y, float z) { return Quatf{ w, x, y, z }; }
+constexpr Quatf Identity() { return Quatf{ 1.f, 0.f, 0.f, 0.f }; }
+
+constexpr Quatf Multiply(const Quatf& a, const Quatf& b)
+{
+	return Quatf{
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w };
+}
+
+constexpr Quatf Conjugate(const Quatf& q) { return Quatf{ q.w, -q.x, -q.y, -q.z }; }
+constexpr float Dot(const Quatf& a, const Quatf& b) { return a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z; }
+constexpr Quatf Scale(const Quatf& q, float s) { return Quatf{ q.w * s, q.x * s, q.y * s, q.z * s }; }
+constexpr Quatf Add(const Quatf& a, const Quatf& b) { return Quatf{ a.w + b.w, a.x + b.x, a.y + b.y, a.z + b.z }; }
+
+// Rotates v by the unit quaternion q
+constexpr Vec3f Rotate(const Quatf& q, const Vec3f& v)
+{
+	// v + 2w(u x v) + 2u x (u x v) with u = (x, y, z)
+	return Vec3f{
+		v.x + 2.f * (q.w * (q.y * v.z - q.z * v.y) + q.y * (q.x * v.y - q.y * v.x) - q.z * (q.z * v.x - q.x * v.z)),
+		v.y + 2.f * (q.w * (q.z * v.x - q.x * v.z) + q.z * (q.y * v.z - q.z * v.y) - q.x * (q.x * v.y - q.y * v.x)),
+		v.z + 2.f * (q.w * (q.x * v.y - q.y * v.x) + q.x * (q.z * v.x - q.x * v.z) - q.y * (q.y * v.z - q.z * v.y)) };
+}
+
+// Normalize, Log, Exp and Slerp stay plain inline functions. They need sqrt, sin, cos and atan2,
+// which aren't constexpr in C++14 (nor in MSVC's CRT later), and a hand-written constexpr
+// series would be what runs at runtime too, since C++14 can't pick a different path for
+// constant evaluation. That would make the reference the *Batch kernels are tested against
+// slower and less exact than libm, for no caller that needs these at compile time.
+inline Quatf Normalize(const Quatf& q)
+{
+	float flLengthSq = Dot(q, q);
+	if (flLengthSq <= 0.f)
+		return Identity();
+	return Scale(q, 1.f / sqrtf(flLengthSq));
+}
+
+inline Vec3f Log(const Quatf& q)
+{
+	float s = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z);
+	float k = s > 1e-7f ? atan2f(s, q.w) / s : 1.f;
+	return Vec3f{ q.x * k, q.y * k, q.z * k };
+}
+
+inline Quatf Exp(const Vec3f& v)
+{
+	float flAngle = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+	float k = flAngle > 1e-7f ? sinf(flAngle) / flAngle : 1.f;
+	return Quatf{ cosf(flAngle), v.x * k, v.y * k, v.z * k };
+}
+
+// Shortest-path spherical interpolation; falls back to a normalized lerp when a and b are nearly equal
+inline Quatf Slerp(const Quatf& a, Quatf b, float t)
+{
+	float d = Dot(a, b);
+	if (d < 0.f)
+	{
+		b = Scale(b, -1.f);
+		d = -d;
+	}
+
+	if (d > 0.9995f)
+		return Normalize(Add(a, Scale(Add(b, Scale(a, -1.f)), t)));
+
+	float flSin = sqrtf(1.f - d * d);
+	float flAngle = atan2f(flSin, d);
+	float wa = sinf((1.f - t) * flAngle) / flSin;
+	float wb = sinf(t * flAngle) / flSin;
+	return Add(Scale(a, wa), Scale(b, wb));
+}
+
+inline vr::HmdQuaternion_t ToHmdQuaternion(const Quatf& q)
+{
+	vr::HmdQuaternion_t result;
+	result.w = q.w;
+	result.x = q.x;
+	result.y = q.y;
+	result.z = q.z;
+	return result;
+}
+
+inline vr::HmdQuaternionf_t ToHmdQuaternionf(const Quatf& q)
+{
+	vr::HmdQuaternionf_t result;
+	result.w = q.w;
+	result.x = q.x;
+	result.y = q.y;
+	result.z = q.z;
+	return result;
+}
+
+inline Quatf FromHmdQuaternion(const vr::HmdQuaternion_t& q)
+{
+	return Quatf{ (float)q.w, (float)q.x, (float)q.y, (float)q.z };
+}
+
+// Rotation from the unit quaternion q, translation from pos
+inline vr::HmdMatrix34_t ToHmdMatrix34(const Quatf& q, const Vec3f& pos)
+{
+	vr::HmdMatrix34_t m;
+	m.m[0][0] = 1.f - 2.f * (q.y * q.y + q.z * q.z);
+	m.m[0][1] = 2.f * (q.x * q.y - q.w * q.z);
+	m.m[0][2] = 2.f * (q.x * q.z + q.w * q.y);
+	m.m[0][3] = pos.x;
+	m.m[1][0] = 2.f * (q.x * q.y + q.w * q.z);
+	m.m[1][1] = 1.f - 2.f * (q.x * q.x + q.z * q.z);
+	m.m[1][2] = 2.f * (q.y * q.z - q.w * q.x);
+	m.m[1][3] = pos.y;
+	m.m[2][0] = 2.f * (q.x * q.z - q.w * q.y);
+	m.m[2][1] = 2.f * (q.y * q.z + q.w * q.x);
+	m.m[2][2] = 1.f - 2.f * (q.x * q.x + q.y * q.y);
+	m.m[2][3] = pos.z;
+	return m;
+}
+
+// --------------------------------------------------------------------------
+// "Smallest three" packing of a unit quaternion into 32 bits: the index of
+// the largest component in (x, y, z, w) order in the top two bits, then the
+// other three in that order with 10 bits each over [-1/sqrt(2), 1/sqrt(2)].
+// The largest component is rebuilt from unit length, so it is stored
+// positive. Worst-case error is under 0.2 degrees.
+// --------------------------------------------------------------------------
+inline uint32_t EncodeSmallestThree(const Quatf& q)
+{
+	float c[4] = { q.x, q.y, q.z, q.w };
+	uint32_t unLargest = 0;
+	for (uint32_t i = 1; i < 4; i++)
+	{
+		if (fabsf(c[i]) > fabsf(c[unLargest]))
+			unLargest = i;
+	}
+	float flSign = c[unLargest] < 0.f ? -1.f : 1.f;
+
+	uint32_t unPacked = unLargest << 30;
+	int nShift = 20;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (i == unLargest)
+			continue;
+		float flUnit = (c[i] * flSign * 1.41421356f + 1.f) * 0.5f;
+		int nValue = (int)(flUnit * 1023.f + 0.5f);
+		nValue = nValue < 0 ? 0 : (nValue > 1023 ? 1023 : nValue);
+		unPacked |= (uint32_t)nValue << nShift;
+		nShift -= 10;
+	}
+	return unPacked;
+}
+
+inline Quatf DecodeSmallestThree(uint32_t unPacked)
+{
+	uint32_t unLargest = unPacked >> 30;
+	float flSmall[3];
+	for (int i = 0; i < 3; i++)
+		flSmall[i] = (((unPacked >> (20 - 10 * i)) & 1023) / 1023.f * 2.f - 1.f) * 0.70710678f;
+
+	float flSumSq = flSmall[0] * flSmall[0] + flSmall[1] * flSmall[1] + flSmall[2] * flSmall[2];
+	float c[4];
+	int nSmall = 0;
+	for (uint32_t i = 0; i < 4; i++)
+		c[i] = i == unLargest ? sqrtf(flSumSq < 1.f ? 1.f - flSumSq : 0.f) : flSmall[nSmall++];
+	return Quatf{ c[3], c[0], c[1], c[2] };
+}
+
+// --------------------------------------------------------------------------
+// Structure-of-arrays views. Every pointer addresses n floats; outputs may
+// alias inputs element for element.
+// --------------------------------------------------------------------------
+struct QuatArray_t
+{
+	float* w;
+	float* x;
+	float* y;
+	float* z;
+};
+
+struct Vec3Array_t
+{
+	float* x;
+	float* y;
+	float* z;
+};
+
+// --------------------------------------------------------------------------
+// SIMD lane abstraction: Vf is a register of floats, Mf a lane mask. The
+// batch kernels below are written once against these.
+// --------------------------------------------------------------------------
+namespace simd
+{
+#if defined( POSEMATH_AVX )
+static const int k_nWidth = 8;
+struct Vf { __m256 v; };
+struct Mf { __m256 v; };
+inline Vf Load(const float* p) { return Vf{ _mm256_loadu_ps(p) }; }
+inline void Store(float* p, Vf a) { _mm256_storeu_ps(p, a.v); }
+inline Vf Set(float f) { return Vf{ _mm256_set1_ps(f) }; }
+inline Vf operator+(Vf a, Vf b) { return Vf{ _mm256_add_ps(a.v, b.v) }; }
+inline Vf operator-(Vf a, Vf b) { return Vf{ _mm256_sub_ps(a.v, b.v) }; }
+inline Vf operator*(Vf a, Vf b) { return Vf{ _mm256_mul_ps(a.v, b.v) }; }
+inline Vf operator/(Vf a, Vf b) { return Vf{ _mm256_div_ps(a.v, b.v) }; }
+inline Vf Sqrt(Vf a) { return Vf{ _mm256_sqrt_ps(a.v) }; }
+inline Vf Min(Vf a, Vf b) { return Vf{ _mm256_min_ps(a.v, b.v) }; }
+inline Vf Max(Vf a, Vf b) { return Vf{ _mm256_max_ps(a.v, b.v) }; }
+inline Vf Floor(Vf a) { return Vf{ _mm256_floor_ps(a.v) }; }
+inline Mf Less(Vf a, Vf b) { return Mf{ _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline Mf Greater(Vf a, Vf b) { return Mf{ _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline Vf Select(Mf m, Vf a, Vf b) { return Vf{ _mm256_blendv_ps(b.v, a.v, m.v) }; }
+#elif defined( POSEMATH_SSE )
+static const int k_nWidth = 4;
+struct Vf { __m128 v; };
+struct Mf { __m128 v; };
+inline Vf Load(const float* p) { return Vf{ _mm_loadu_ps(p) }; }
+inline void Store(float* p, Vf a) { _mm_storeu_ps(p, a.v); }
+inline Vf Set(float f) { return Vf{ _mm_set1_ps(f) }; }
+inline Vf operator+(Vf a, Vf b) { return Vf{ _mm_add_ps(a.v, b.v) }; }
+inline Vf operator-(Vf a, Vf b) { return Vf{ _mm_sub_ps(a.v, b.v) }; }
+inline Vf operator*(Vf a, Vf b) { return Vf{ _mm_mul_ps(a.v, b.v) }; }
+inline Vf operator/(Vf a, Vf b) { return Vf{ _mm_div_ps(a.v, b.v) }; }
+inline Vf Sqrt(Vf a) { return Vf{ _mm_sqrt_ps(a.v) }; }
+inline Vf Min(Vf a, Vf b) { return Vf{ _mm_min_ps(a.v, b.v) }; }
+inline Vf Max(Vf a, Vf b) { return Vf{ _mm_max_ps(a.v, b.v) }; }
+inline Mf Less(Vf a, Vf b) { return Mf{ _mm_cmplt_ps(a.v, b.v) }; }
+inline Mf Greater(Vf a, Vf b) { return Mf{ _mm_cmpgt_ps(a.v, b.v) }; }
+inline Vf Select(Mf m, Vf a, Vf b) { return Vf{ _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) }; }
+inline Vf Floor(Vf a)
+{
+	// SSE2 has no floor: truncate, then step down where truncation rounded up (negative inputs)
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+	return Vf{ _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.f))) };
+}
+#elif defined( POSEMATH_NEON )
+static const int k_nWidth = 4;
+struct Vf { float32x4_t v; };
+struct Mf { uint32x4_t v; };
+inline Vf Load(const float* p) { return Vf{ vld1q_f32(p) }; }
+inline void Store(float* p, Vf a) { vst1q_f32(p, a.v); }
+inline Vf Set(float f) { return Vf{ vdupq_n_f32(f) }; }
+inline Vf operator+(Vf a, Vf b) { return Vf{ vaddq_f32(a.v, b.v) }; }
+inline Vf operator-(Vf a, Vf b) { return Vf{ vsubq_f32(a.v, b.v) }; }
+inline Vf operator*(Vf a, Vf b) { return Vf{ vmulq_f32(a.v, b.v) }; }
+inline Vf operator/(Vf a, Vf b) { return Vf{ vdivq_f32(a.v, b.v) }; }
+inline Vf Sqrt(Vf a) { return Vf{ vsqrtq_f32(a.v) }; }
+inline Vf Min(Vf a, Vf b) { return Vf{ vminq_f32(a.v, b.v) }; }
+inline Vf Max(Vf a, Vf b) { return Vf{ vmaxq_f32(a.v, b.v) }; }
+inline Vf Floor(Vf a) { return Vf{ vrndmq_f32(a.v) }; }
+inline Mf Less(Vf a, Vf b) { return Mf{ vcltq_f32(a.v, b.v) }; }
+inline Mf Greater(Vf a, Vf b) { return Mf{ vcgtq_f32(a.v, b.v) }; }
+inline Vf Select(Mf m, Vf a, Vf b) { return Vf{ vbslq_f32(m.v, a.v, b.v) }; }
+#else
+static const int k_nWidth = 1;
+struct Vf { float v; };
+struct Mf { bool v; };
+inline Vf Load(const float* p) { return Vf{ *p }; }
+inline void Store(float* p, Vf a) { *p = a.v; }
+inline Vf Set(float f) { return Vf{ f }; }
+inline Vf operator+(Vf a, Vf b) { return Vf{ a.v + b.v }; }
+inline Vf operator-(Vf a, Vf b) { return Vf{ a.v - b.v }; }
+inline Vf operator*(Vf a, Vf b) { return Vf{ a.v * b.v }; }
+inline Vf operator/(Vf a, Vf b) { return Vf{ a.v / b.v }; }
+inline Vf Sqrt(Vf a) { return Vf{ sqrtf(a.v) }; }
+inline Vf Min(Vf a, Vf b) { return Vf{ a.v < b.v ? a.v : b.v }; }
+inline Vf Max(Vf a, Vf b) { return Vf{ a.v > b.v ? a.v : b.v }; }
+inline Vf Floor(Vf a) { return Vf{ floorf(a.v) }; }
+inline Mf Less(Vf a, Vf b) { return Mf{ a.v < b.v }; }
+inline Mf Greater(Vf a, Vf b) { return Mf{ a.v > b.v }; }
+inline Vf Select(Mf m, Vf a, Vf b) { return Vf{ m.v ? a.v : b.v }; }
+#endif
+
+inline Vf Negate(Vf a) { return Set(0.f) - a; }
+
+struct Quat_t { Vf w, x, y, z; };
+struct Vec3_t { Vf x, y, z; };
+
+inline Quat_t LoadQuat(const QuatArray_t& a, size_t i) { return Quat_t{ Load(a.w + i), Load(a.x + i), Load(a.y + i), Load(a.z + i) }; }
+inline void StoreQuat(const QuatArray_t& a, size_t i, const Quat_t& q) { Store(a.w + i, q.w); Store(a.x + i, q.x); Store(a.y + i, q.y); Store(a.z + i, q.z); }
+inline Vec3_t LoadVec3(const Vec3Array_t& a, size_t i) { return Vec3_t{ Load(a.x + i), Load(a.y + i), Load(a.z + i) }; }
+inline void StoreVec3(const Vec3Array_t& a, size_t i, const Vec3_t& v) { Store(a.x + i, v.x); Store(a.y + i, v.y); Store(a.z + i, v.z); }
+
+inline Quat_t Multiply(const Quat_t& a, const Quat_t& b)
+{
+	return Quat_t{
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w };
+}
+
+inline Quat_t Normalize(const Quat_t& q)
+{
+	Vf flLengthSq = q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z;
+	Mf bValid = Greater(flLengthSq, Set(0.f));
+	Vf flInv = Set(1.f) / Sqrt(Select(bValid, flLengthSq, Set(1.f)));
+	return Quat_t{ Select(bValid, q.w * flInv, Set(1.f)), Select(bValid, q.x * flInv, Set(0.f)), Select(bValid, q.y * flInv, Set(0.f)), Select(bValid, q.z * flInv, Set(0.f)) };
+}
+
+// atan2 for y >= 0, result in [0, pi]. Cephes atanf polynomial after reducing to |t| <= tan(pi/8).
+inline Vf Atan2Upper(Vf y, Vf x)
+{
+	Vf ax = Max(x, Negate(x));
+	Vf flMax = Max(y, ax);
+	Vf t = Min(y, ax) / Select(Greater(flMax, Set(0.f)), flMax, Set(1.f));
+
+	Mf bReduce = Greater(t, Set(0.4142135623730950f));
+	Vf r = Select(bReduce, (t - Set(1.f)) / (t + Set(1.f)), t);
+	Vf z = r * r;
+	Vf p = (((Set(8.05374449538e-2f) * z - Set(1.38776856032e-1f)) * z + Set(1.99777106478e-1f)) * z - Set(3.33329491539e-1f)) * z * r + r;
+	Vf a = Select(bReduce, p + Set(0.78539816339744830962f), p);
+
+	a = Select(Greater(y, ax), Set(1.57079632679489661923f) - a, a);
+	return Select(Less(x, Set(0.f)), Set(3.14159265358979323846f) - a, a);
+}
+
+// sin and cos for x >= 0, Cephes sinf/cosf polynomials after reduction to [-pi/4, pi/4]
+inline void SinCos(Vf x, Vf* pSin, Vf* pCos)
+{
+	Vf j = Floor(x * Set(1.27323954473516f));	// 4 / pi
+	j = j + (j - Set(2.f) * Floor(j * Set(0.5f)));	// round up to even
+	Vf r = ((x - j * Set(0.78515625f)) - j * Set(2.4187564849853515625e-4f)) - j * Set(3.77489497744594108e-8f);
+
+	Vf q = j * Set(0.5f);					// quadrant
+	q = q - Set(4.f) * Floor(q * Set(0.25f));	// mod 4
+	Mf bSwap = Greater(q - Set(2.f) * Floor(q * Set(0.5f)), Set(0.5f));
+	Vf flSinSign = Select(Greater(q, Set(1.5f)), Set(-1.f), Set(1.f));
+	Vf flCosSign = Select(Greater(q, Set(0.5f)), Select(Less(q, Set(2.5f)), Set(-1.f), Set(1.f)), Set(1.f));
+
+	Vf z = r * r;
+	Vf s = ((Set(-1.9515295891e-4f) * z + Set(8.3321608736e-3f)) * z - Set(1.6666654611e-1f)) * z * r + r;
+	Vf c = ((Set(2.443315711809948e-5f) * z - Set(1.388731625493765e-3f)) * z + Set(4.166664568298827e-2f)) * z * z - Set(0.5f) * z + Set(1.f);
+
+	*pSin = Select(bSwap, c, s) * flSinSign;
+	*pCos = Select(bSwap, s, c) * flCosSign;
+}
+
+inline Vec3_t Log(const Quat_t& q)
+{
+	Vf s = Sqrt(q.x * q.x + q.y * q.y + q.z * q.z);
+	Mf bSmall = Less(s, Set(1e-7f));
+	Vf k = Select(bSmall, Set(1.f), Atan2Upper(s, q.w) / Select(bSmall, Set(1.f), s));
+	return Vec3_t{ q.x * k, q.y * k, q.z * k };
+}
+
+// expects |v| <= pi, which covers everything Log returns
+inline Quat_t Exp(const Vec3_t& v)
+{
+	Vf flAngle = Sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+	Vf flSin, flCos;
+	SinCos(flAngle, &flSin, &flCos);
+	Mf bSmall = Less(flAngle, Set(1e-7f));
+	Vf k = Select(bSmall, Set(1.f), flSin / Select(bSmall, Set(1.f), flAngle));
+	return Quat_t{ flCos, v.x * k, v.y * k, v.z * k };
+}
+
+inline Quat_t Slerp(const Quat_t& a, Quat_t b, Vf t)
+{
+	Vf d = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+	Mf bFlip = Less(d, Set(0.f));
+	Vf flSign = Select(bFlip, Set(-1.f), Set(1.f));
+	b = Quat_t{ b.w * flSign, b.x * flSign, b.y * flSign, b.z * flSign };
+	d = d * flSign;
+
+	Quat_t lerp = Normalize(Quat_t{ a.w + (b.w - a.w) * t, a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t });
+
+	Mf bNear = Greater(d, Set(0.9995f));
+	Vf flSinAngle = Sqrt(Max(Set(1.f) - d * d, Set(0.f)));
+	Vf flAngle = Atan2Upper(flSinAngle, d);
+	Vf flSinA, flSinB, flUnused;
+	SinCos((Set(1.f) - t) * flAngle, &flSinA, &flUnused);
+	SinCos(t * flAngle, &flSinB, &flUnused);
+	Vf flInvSin = Set(1.f) / Select(bNear, Set(1.f), flSinAngle);
+	Vf wa = flSinA * flInvSin;
+	Vf wb = flSinB * flInvSin;
+
+	return Quat_t{
+		Select(bNear, lerp.w, a.w * wa + b.w * wb),
+		Select(bNear, lerp.x, a.x * wa + b.x * wb),
+		Select(bNear, lerp.y, a.y * wa + b.y * wb),
+		Select(bNear, lerp.z, a.z * wa + b.z * wb) };
+}
+
+// --------------------------------------------------------------------------
+// Runs kernel(i) over full registers and then once more over a zero padded
+// copy of the remainder, so the tail goes through the same code as the rest.
+// --------------------------------------------------------------------------
+template <int IN, int OUT, typename Kernel>
+inline void ForEachBlock(size_t n, float* const (&inputs)[IN], float* const (&outputs)[OUT], Kernel kernel)
+{
+	size_t i = 0;
+	for (; i + k_nWidth <= n; i += k_nWidth)
+		kernel(inputs, outputs, i);
+
+	size_t nTail = n - i;
+	if (nTail == 0)
+		return;
+
+	float tailIn[IN][k_nWidth] = {};
+	float tailOut[OUT][k_nWidth] = {};
+	float* pIn[IN];
+	float* pOut[OUT];
+	for (int a = 0; a < IN; a++)
+	{
+		for (size_t l = 0; l < nTail; l++)
+			tailIn[a][l] = inputs[a][i + l];
+		pIn[a] = tailIn[a];
+	}
+	for (int a = 0; a < OUT; a++)
+		pOut[a] = tailOut[a];
+
+	kernel(pIn, pOut, 0);
+
+	for (int a = 0; a < OUT; a++)
+	{
+		for (size_t l = 0; l < nTail; l++)
+			outputs[a][i + l] = tailOut[a][l];
+	}
+}
+} // namespace simd
+
+// out[i] = a[i] * b[i]
+inline void MultiplyBatch(const QuatArray_t& a, const QuatArray_t& b, const QuatArray_t& out, size_t n)
+{
+	float* const in[8] = { a.w, a.x, a.y, a.z, b.w, b.x, b.y, b.z };
+	float* const outs[4] = { out.w, out.x, out.y, out.z };
+	simd::ForEachBlock(n, in, outs, [](float* const (&in)[8], float* const (&outs)[4], size_t i) {
+		simd::Quat_t r = simd::Multiply(simd::LoadQuat(QuatArray_t{ in[0], in[1], in[2], in[3] }, i), simd::LoadQuat(QuatArray_t{ in[4], in[5], in[6], in[7] }, i));
+		simd::StoreQuat(QuatArray_t{ outs[0], outs[1], outs[2], outs[3] }, i, r);
+	});
+}
+
+inline void NormalizeBatch(const QuatArray_t& q, const QuatArray_t& out, size_t n)
+{
+	float* const in[4] = { q.w, q.x, q.y, q.z };
+	float* const outs[4] = { out.w, out.x, out.y, out.z };
+	simd::ForEachBlock(n, in, outs, [](float* const (&in)[4], float* const (&outs)[4], size_t i) {
+		simd::StoreQuat(QuatArray_t{ outs[0], outs[1], outs[2], outs[3] }, i, simd::Normalize(simd::LoadQuat(QuatArray_t{ in[0], in[1], in[2], in[3] }, i)));
+	});
+}
+
+// out[i] = Slerp(a[i], b[i], t[i])
+inline void SlerpBatch(const QuatArray_t& a, const QuatArray_t& b, const float* t, const QuatArray_t& out, size_t n)
+{
+	float* const in[9] = { a.w, a.x, a.y, a.z, b.w, b.x, b.y, b.z, const_cast<float*>(t) };
+	float* const outs[4] = { out.w, out.x, out.y, out.z };
+	simd::ForEachBlock(n, in, outs, [](float* const (&in)[9], float* const (&outs)[4], size_t i) {
+		simd::Quat_t r = simd::Slerp(simd::LoadQuat(QuatArray_t{ in[0], in[1], in[2], in[3] }, i), simd::LoadQuat(QuatArray_t{ in[4], in[5], in[6], in[7] }, i), simd::Load(in[8] + i));
+		simd::StoreQuat(QuatArray_t{ outs[0], outs[1], outs[2], outs[3] }, i, r);
+	});
+}
+
+inline void LogBatch(const QuatArray_t& q, const Vec3Array_t& out, size_t n)
+{
+	float* const in[4] = { q.w, q.x, q.y, q.z };
+	float* const outs[3] = { out.x, out.y, out.z };
+	simd::ForEachBlock(n, in, outs, [](float* const (&in)[4], float* const (&outs)[3], size_t i) {
+		simd::StoreVec3(Vec3Array_t{ outs[0], outs[1], outs[2] }, i, simd::Log(simd::LoadQuat(QuatArray_t{ in[0], in[1], in[2], in[3] }, i)));
+	});
+}
+
+// expects |v[i]| <= pi
+inline void ExpBatch(const Vec3Array_t& v, const QuatArray_t& out, size_t n)
+{
+	float* const in[3] = { v.x, v.y, v.z };
+	float* const outs[4] = { out.w, out.x, out.y, out.z };
+	simd::ForEachBlock(n, in, outs, [](float* const (&in)[3], float* const (&outs)[4], size_t i) {
+		simd::StoreQuat(QuatArray_t{ outs[0], outs[1], outs[2], outs[3] }, i, simd::Exp(simd::LoadVec3(Vec3Array_t{ in[0], in[1], in[2] }, i)));
+	});
+}
+
+// Expands quaternions packed with EncodeSmallestThree
+inline void DecodeSmallestThreeBatch(const uint32_t* pPacked, const QuatArray_t& out, size_t n)
+{
+	using namespace simd;
+
+	for (size_t i = 0; i < n; i += k_nWidth)
+	{
+		size_t nLanes = n - i < (size_t)k_nWidth ? n - i : (size_t)k_nWidth;
+
+		// bit fields are split per lane, the reconstruction runs on whole registers
+		float fields[4][k_nWidth] = {};
+		for (size_t l = 0; l < nLanes; l++)
+		{
+			uint32_t unPacked = pPacked[i + l];
+			fields[0][l] = (float)((unPacked >> 20) & 1023);
+			fields[1][l] = (float)((unPacked >> 10) & 1023);
+			fields[2][l] = (float)(unPacked & 1023);
+			fields[3][l] = (float)(unPacked >> 30);
+		}
+
+		Vf scale = Set(2.f / 1023.f * 0.70710678f);
+		Vf offset = Set(-0.70710678f);
+		Vf a = Load(fields[0]) * scale + offset;
+		Vf b = Load(fields[1]) * scale + offset;
+		Vf c = Load(fields[2]) * scale + offset;
+		Vf flLargest = Load(fields[3]);
+		Vf d = Sqrt(Max(Set(1.f) - a * a - b * b - c * c, Set(0.f)));
+
+		// the three stored components fill the remaining slots of (x, y, z, w) in order
+		Mf bIs0 = Less(flLargest, Set(0.5f));
+		Mf bAtMost1 = Less(flLargest, Set(1.5f));
+		Mf bAtMost2 = Less(flLargest, Set(2.5f));
+		Quat_t q;
+		q.x = Select(bIs0, d, a);
+		q.y = Select(bIs0, a, Select(bAtMost1, d, b));
+		q.z = Select(bAtMost1, b, Select(bAtMost2, d, c));
+		q.w = Select(bAtMost2, c, d);
+
+		if (nLanes == (size_t)k_nWidth)
+		{
+			StoreQuat(out, i, q);
+		}
+		else
+		{
+			float tail[4][k_nWidth];
+			StoreQuat(QuatArray_t{ tail[0], tail[1], tail[2], tail[3] }, 0, q);
+			for (size_t l = 0; l < nLanes; l++)
+			{
+				out.w[i + l] = tail[0][l];
+				out.x[i + l] = tail[1][l];
+				out.y[i + l] = tail[2][l];
+				out.z[i + l] = tail[3][l];
+			}
+		}
+	}
+}
+
+// Builds pose matrices from unit quaternions; pos may be null for no translation
+inline void ToHmdMatrix34Batch(const QuatArray_t& q, const Vec3Array_t* pPos, vr::HmdMatrix34_t* pOut, size_t n)
+{
+	using namespace simd;
+
+	float rotation[9][k_nWidth];
+	for (size_t i = 0; i < n; i += k_nWidth)
+	{
+		size_t nLanes = n - i < (size_t)k_nWidth ? n - i : (size_t)k_nWidth;
+
+		Quat_t v;
+		if (nLanes == (size_t)k_nWidth)
+		{
+			v = LoadQuat(q, i);
+		}
+		else
+		{
+			float tail[4][k_nWidth] = {};
+			for (size_t l = 0; l < nLanes; l++)
+			{
+				tail[0][l] = q.w[i + l];
+				tail[1][l] = q.x[i + l];
+				tail[2][l] = q.y[i + l];
+				tail[3][l] = q.z[i + l];
+			}
+			v = LoadQuat(QuatArray_t{ tail[0], tail[1], tail[2], tail[3] }, 0);
+		}
+
+		Vf two = Set(2.f);
+		Vf one = Set(1.f);
+		Store(rotation[0], one - two * (v.y * v.y + v.z * v.z));
+		Store(rotation[1], two * (v.x * v.y - v.w * v.z));
+		Store(rotation[2], two * (v.x * v.z + v.w * v.y));
+		Store(rotation[3], two * (v.x * v.y + v.w * v.z));
+		Store(rotation[4], one - two * (v.x * v.x + v.z * v.z));
+		Store(rotation[5], two * (v.y * v.z - v.w * v.x));
+		Store(rotation[6], two * (v.x * v.z - v.w * v.y));
+		Store(rotation[7], two * (v.y * v.z + v.w * v.x));
+		Store(rotation[8], one - two * (v.x * v.x + v.y * v.y));
+
+		for (size_t l = 0; l < nLanes; l++)
+		{
+			vr::HmdMatrix34_t& m = pOut[i + l];
+			for (int r = 0; r < 3; r++)
+			{
+				m.m[r][0] = rotation[r * 3 + 0][l];
+				m.m[r][1] = rotation[r * 3 + 1][l];
+				m.m[r][2] = rotation[r * 3 + 2][l];
+			}
+			m.m[0][3] = pPos ? pPos->x[i + l] : 0.f;
+			m.m[1][3] = pPos ? pPos->y[i + l] : 0.f;
+			m.m[2][3] = pPos ? pPos->z[i + l] : 0.f;
+		}
+	}
+}
+
+} // namespace posemath
+
+#endif // POSE_MATH_H
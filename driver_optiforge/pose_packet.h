@@ -0,0 +1,78 @@
+#ifndef POSE_PACKET_H
+#define POSE_PACKET_H
+
+#pragma once
+
+#include <string.h>
+#include "pose_state.h"
+
+// One orientation on the TCP stream: four little-endian floats x, y, z, w
+static const int k_nPosePacketSize = 16;
+
+// --------------------------------------------------------------------------
+// Purpose: Cuts the TCP byte stream back into pose packets. recv() may return
+//          any number of bytes, so a packet can arrive split across calls or
+//          several can arrive at once; only the newest complete one matters.
+// --------------------------------------------------------------------------
+class CPosePacketReader
+{
+public:
+	void Reset() { m_nPartial = 0; }
+
+	// Returns the number of packets completed by pData and copies the newest of them to quat
+	int Feed(const char* pData, int nSize, float quat[4])
+	{
+		int nPackets = 0;
+
+		if (m_nPartial > 0)
+		{
+			int nTake = k_nPosePacketSize - m_nPartial;
+			if (nTake > nSize)
+				nTake = nSize;
+			memcpy(m_partial + m_nPartial, pData, nTake);
+			m_nPartial += nTake;
+			pData += nTake;
+			nSize -= nTake;
+
+			if (m_nPartial < k_nPosePacketSize)
+				return 0;
+
+			memcpy(quat, m_partial, k_nPosePacketSize);
+			m_nPartial = 0;
+			nPackets++;
+		}
+
+		int nWhole = nSize / k_nPosePacketSize;
+		if (nWhole > 0)
+		{
+			memcpy(quat, pData + (nWhole - 1) * k_nPosePacketSize, k_nPosePacketSize);
+			nPackets += nWhole;
+		}
+
+		m_nPartial = nSize - nWhole * k_nPosePacketSize;
+		memcpy(m_partial, pData + nWhole * k_nPosePacketSize, m_nPartial);
+		return nPackets;
+	}
+
+private:
+	char m_partial[k_nPosePacketSize];
+	int m_nPartial = 0;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: One recv() worth of the TCP pose stream: cut into packets, with the
+//          newest complete one published to poseState. Returns the number of
+//          packets completed, 0 when no new pose is readable yet. ReceiveTCP
+//          and everything that measures or soaks the receive path go through
+//          here, so they run the driver's own code.
+// --------------------------------------------------------------------------
+inline int ReceivePoseStream(CPosePacketReader* pReader, CPoseState* pPoseState, const char* pData, int nSize)
+{
+	float quat[4] = { 0.f, 0.f, 0.f, 1.f };
+	int nPackets = pReader->Feed(pData, nSize, quat);
+	if (nPackets > 0)
+		pPoseState->Update(quat, 0);
+	return nPackets;
+}
+
+#endif // POSE_PACKET_H
@@ -0,0 +1,142 @@
+#ifndef POSE_STATE_H
+#define POSE_STATE_H
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string.h>
+#include <stdint.h>
+#include <openvr_driver.h>
+
+struct PoseSample_t
+{
+	float quat[4];			// x, y, z, w
+	float position[3];		// meters, in the driver's tracking space
+	uint64_t ulTimestampUs;	// 0 when the transport doesn't carry a sample time
+};
+
+// Where the head is for transports that only carry an orientation: standing at the origin
+static const float k_flDefaultHeadPosition[3] = { 0.f, 1.7f, 0.f };
+
+// Samples kept by arrival time, about a quarter second of a 500 Hz stream
+static const uint32_t k_unPoseHistorySize = 128;
+
+// --------------------------------------------------------------------------
+// Purpose: Latest orientation handed from the receive thread to GetPose, and
+//          the last few by when they arrived for anything that has to match
+//          the head pose of an earlier moment, like a hand frame that spent
+//          a camera exposure and a trip over the network getting here.
+// --------------------------------------------------------------------------
+class CPoseState
+{
+public:
+	void Update(const float quat[4], uint64_t ulTimestampUs)
+	{
+		Update(quat, k_flDefaultHeadPosition, ulTimestampUs);
+	}
+
+	void Update(const float quat[4], const float position[3], uint64_t ulTimestampUs)
+	{
+		uint64_t ulArrivedUs = ArrivalNowUs();
+		std::lock_guard<std::mutex> lock(m_mutex);  // Ensure thread safety
+		memcpy(m_sample.quat, quat, sizeof(m_sample.quat));
+		memcpy(m_sample.position, position, sizeof(m_sample.position));
+		m_sample.ulTimestampUs = ulTimestampUs;
+
+		HistoryEntry_t& entry = m_history[m_unHistoryCount++ % k_unPoseHistorySize];
+		entry.ulArrivedUs = ulArrivedUs;
+		entry.sample = m_sample;
+	}
+
+	PoseSample_t Read() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex); // Scoped lock for thread safety
+		return m_sample;
+	}
+
+	// The newest sample that had arrived by ulArrivedUs (on the ArrivalNowUs() clock), or the
+	// oldest one kept if the history doesn't reach back that far
+	PoseSample_t ReadArrivedBy(uint64_t ulArrivedUs) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		uint32_t unKept = m_unHistoryCount < k_unPoseHistorySize ? m_unHistoryCount : k_unPoseHistorySize;
+		for (uint32_t i = 1; i <= unKept; i++)
+		{
+			const HistoryEntry_t& entry = m_history[(m_unHistoryCount - i) % k_unPoseHistorySize];
+			if (entry.ulArrivedUs <= ulArrivedUs || i == unKept)
+				return entry.sample;
+		}
+		return m_sample;
+	}
+
+	static uint64_t ArrivalNowUs()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+private:
+	struct HistoryEntry_t
+	{
+		uint64_t ulArrivedUs;
+		PoseSample_t sample;
+	};
+
+	mutable std::mutex m_mutex;
+	PoseSample_t m_sample = { { 0.f, 0.f, 0.f, 1.f }, { k_flDefaultHeadPosition[0], k_flDefaultHeadPosition[1], k_flDefaultHeadPosition[2] }, 0 };
+	HistoryEntry_t m_history[k_unPoseHistorySize];
+	uint32_t m_unHistoryCount = 0;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: Turns a pose sample into what the HMD reports to the runtime.
+//          ulNowUs is on the same clock as the sample timestamp and has to be
+//          read after the sample was.
+// --------------------------------------------------------------------------
+inline vr::DriverPose_t BuildHmdPose(const PoseSample_t& sample, bool bSourceAlive, uint64_t ulNowUs)
+{
+	// First, initialize the struct that we'll be submitting to the runtime to tell it we've updated our pose.
+	vr::DriverPose_t pose = {};
+
+	// These need to be set to be valid quaternions. The device won't appear otherwise.
+	pose.qWorldFromDriverRotation.w = 1.f;
+	pose.qDriverFromHeadRotation.w = 1.f;
+
+	pose.qRotation.x = sample.quat[0];
+	pose.qRotation.y = sample.quat[1];
+	pose.qRotation.z = sample.quat[2];
+	pose.qRotation.w = sample.quat[3];
+
+	// Producers that timestamp their samples let the runtime predict from the real sample age.
+	// A producer clock running slightly ahead stamps samples after ulNowUs; those count as brand
+	// new instead of wrapping around to an age of hours.
+	if (sample.ulTimestampUs != 0) {
+		int64_t nAgeUs = (int64_t)(ulNowUs - sample.ulTimestampUs);
+		pose.poseTimeOffset = -(double)(nAgeUs > 0 ? nAgeUs : 0) / 1000000.0;
+	}
+
+	pose.vecPosition[0] = sample.position[0];
+	pose.vecPosition[1] = sample.position[1];
+	pose.vecPosition[2] = sample.position[2];
+
+	// The pose we provided is valid.
+	// This should be set is
+	pose.poseIsValid = true;
+
+	// Our device is always connected.
+	// In reality with physical devices, when they get disconnected,
+	// set this to false and icons in SteamVR will be updated to show the device is disconnected
+	pose.deviceIsConnected = true;
+
+	// The state of our tracking. For our virtual device, it's always going to be ok,
+	// but this can get set differently to inform the runtime about the state of the device's tracking
+	// and update the icons to inform the user accordingly.
+	pose.result = bSourceAlive ? vr::TrackingResult_Running_OK : vr::TrackingResult_Running_OutOfRange;
+
+	// For HMDs we want to apply rotation/motion prediction
+	pose.shouldApplyHeadModel = true;
+
+	return pose;
+}
+
+#endif // POSE_STATE_H
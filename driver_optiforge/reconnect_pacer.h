@@ -0,0 +1,42 @@
+#ifndef RECONNECT_PACER_H
+#define RECONNECT_PACER_H
+
+#pragma once
+
+#include <chrono>
+
+// Wait between connect attempts while the sender can't be reached
+static const std::chrono::milliseconds k_reconnectDelay(1000);
+
+// A connection lost sooner than this after it was made waits k_reconnectDelay as well
+static const std::chrono::milliseconds k_minConnectionLifetime(1000);
+
+// --------------------------------------------------------------------------
+// Purpose: When a TCP receive loop may try to connect again. A connection
+//          that was up for a while is reopened right away, since the sender
+//          is usually back at once after a reset or a Wi-Fi roam. Failed
+//          connects, and connections that die straight after being made
+//          (a sender that accepts and drops us), wait k_reconnectDelay, so
+//          neither turns the loop into a busy loop that floods the log.
+//          Shared by every loop that receives from the glasses, and by the
+//          netproxy soak receiver so a soak run measures this policy.
+// --------------------------------------------------------------------------
+class CReconnectPacer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	void Connected(Clock::time_point now) { m_connectedAt = now; }
+
+	std::chrono::milliseconds DelayAfterConnectFailure() const { return k_reconnectDelay; }
+
+	std::chrono::milliseconds DelayAfterConnectionLost(Clock::time_point now) const
+	{
+		return now - m_connectedAt < k_minConnectionLifetime ? k_reconnectDelay : std::chrono::milliseconds(0);
+	}
+
+private:
+	Clock::time_point m_connectedAt;
+};
+
+#endif // RECONNECT_PACER_H
@@ -0,0 +1,202 @@
+#include "pch.h"
+#include "render_governor.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+static bool SameSettings(const RenderGovernorSettings_t& a, const RenderGovernorSettings_t& b)
+{
+	return a.flMinScale == b.flMinScale
+		&& a.flMaxScale == b.flMaxScale
+		&& a.flStep == b.flStep
+		&& a.flTargetLoad == b.flTargetLoad
+		&& a.flRaiseBelowLoad == b.flRaiseBelowLoad
+		&& a.flLowerAboveLoad == b.flLowerAboveLoad
+		&& a.flSmoothing == b.flSmoothing
+		&& a.unSettleFrames == b.unSettleFrames
+		&& a.unHoldAfterMissFrames == b.unHoldAfterMissFrames
+		&& a.unNoRaiseAfterMissFrames == b.unNoRaiseAfterMissFrames;
+}
+
+CRenderGovernor::CRenderGovernor()
+{
+	m_bConfigured = false;
+	Configure(RenderGovernorSettings_t(), 90.f);
+}
+
+void CRenderGovernor::Configure(const RenderGovernorSettings_t& settings, float flDisplayFrequency)
+{
+	RenderGovernorSettings_t clamped = settings;
+	clamped.flMinScale = std::max(clamped.flMinScale, 0.1f);
+	clamped.flMaxScale = std::max(clamped.flMaxScale, clamped.flMinScale);
+	clamped.flStep = std::max(clamped.flStep, 0.01f);
+	float flBudgetMs = 1000.f / (flDisplayFrequency > 0.f ? flDisplayFrequency : 90.f);
+
+	if (m_bConfigured && SameSettings(clamped, m_settings) && flBudgetMs == m_flBudgetMs)
+		return;
+
+	m_bConfigured = true;
+	m_settings = clamped;
+	m_flBudgetMs = flBudgetMs;
+	Reset();
+}
+
+void CRenderGovernor::Reset()
+{
+	m_flScale = Quantize(m_settings.flMaxScale);
+	m_flGpuMs = 0.f;
+	m_flCompositorGpuMs = 0.f;
+	m_flCpuMs = 0.f;
+	m_bHaveSample = false;
+	m_unFramesSinceChange = 0;
+	m_unFramesSinceMiss = m_settings.unNoRaiseAfterMissFrames;
+}
+
+void CRenderGovernor::ResumeAt(float flScale)
+{
+	Reset();
+	m_flScale = Quantize(flScale);
+}
+
+bool CRenderGovernor::AddSample(const FrameTimingSample_t& sample)
+{
+	if (!m_bHaveSample)
+	{
+		m_flGpuMs = sample.flGpuMs;
+		m_flCompositorGpuMs = sample.flCompositorGpuMs;
+		m_flCpuMs = sample.flCpuMs;
+		m_bHaveSample = true;
+	}
+	else
+	{
+		m_flGpuMs += (sample.flGpuMs - m_flGpuMs) * m_settings.flSmoothing;
+		m_flCompositorGpuMs += (sample.flCompositorGpuMs - m_flCompositorGpuMs) * m_settings.flSmoothing;
+		m_flCpuMs += (sample.flCpuMs - m_flCpuMs) * m_settings.flSmoothing;
+	}
+	m_unFramesSinceChange++;
+	if (sample.unMissedFrames > 0)
+		m_unFramesSinceMiss = 0;
+	else if (m_unFramesSinceMiss < m_settings.unNoRaiseAfterMissFrames)
+		m_unFramesSinceMiss++;
+
+	// A missed frame is the only signal that doesn't wait for the average to catch up
+	if (sample.unMissedFrames > 0 && m_unFramesSinceChange >= m_settings.unHoldAfterMissFrames)
+	{
+		return SetScale(m_flScale - m_settings.flStep);
+	}
+
+	if (m_unFramesSinceChange < m_settings.unSettleFrames || m_flGpuMs <= 0.f)
+		return false;
+
+	float flGpuLoad = (m_flGpuMs + m_flCompositorGpuMs) / m_flBudgetMs;
+	float flCpuLoad = m_flCpuMs / m_flBudgetMs;
+
+	// The application's time ~ scale^2, so the scale that puts it on what the target leaves
+	// after the compositor is scale * sqrt(available / current). When the compositor alone
+	// eats the target there is nothing to size for and the minimum is all that's left.
+	float flAvailableMs = m_settings.flTargetLoad * m_flBudgetMs - m_flCompositorGpuMs;
+	float flIdealScale = flAvailableMs > 0.f ? m_flScale * std::sqrt(flAvailableMs / m_flGpuMs) : m_settings.flMinScale;
+
+	if (flGpuLoad > m_settings.flLowerAboveLoad)
+	{
+		return SetScale(std::min(flIdealScale, m_flScale - m_settings.flStep));
+	}
+
+	// Growing doesn't help a CPU bound app and would only eat the GPU headroom it has left
+	if (flGpuLoad < m_settings.flRaiseBelowLoad && flCpuLoad < m_settings.flLowerAboveLoad && m_unFramesSinceMiss >= m_settings.unNoRaiseAfterMissFrames)
+	{
+		return SetScale(std::max(flIdealScale, m_flScale + m_settings.flStep));
+	}
+
+	return false;
+}
+
+float CRenderGovernor::Quantize(float flScale) const
+{
+	flScale = std::min(std::max(flScale, m_settings.flMinScale), m_settings.flMaxScale);
+
+	// the range needn't be a whole number of steps, the maximum is reachable anyway
+	if (flScale > m_settings.flMaxScale - 0.001f)
+		return m_settings.flMaxScale;
+
+	float flSteps = std::floor((flScale - m_settings.flMinScale) / m_settings.flStep + 0.001f);
+	return std::min(m_settings.flMinScale + flSteps * m_settings.flStep, m_settings.flMaxScale);
+}
+
+bool CRenderGovernor::SetScale(float flScale)
+{
+	float flNewScale = Quantize(flScale);
+	if (std::fabs(flNewScale - m_flScale) < 0.001f)
+		return false;
+
+	// the smoothed application time was measured at the old size, carry it over with the same model
+	float flRatio = flNewScale / m_flScale;
+	m_flGpuMs *= flRatio * flRatio;
+
+	m_flScale = flNewScale;
+	m_unFramesSinceChange = 0;
+	return true;
+}
+
+FrameTimingSample_t RescaleFrameTimingSample(const FrameTimingSample_t& sample, float flRenderedScale, float flScale, float flDisplayFrequency)
+{
+	float flBudgetMs = 1000.f / (flDisplayFrequency > 0.f ? flDisplayFrequency : 90.f);
+	float flRatio = flRenderedScale > 0.f ? flScale / flRenderedScale : 1.f;
+
+	FrameTimingSample_t rescaled = sample;
+	rescaled.flGpuMs *= flRatio * flRatio;
+
+	bool bGpuBound = sample.flGpuMs + sample.flCompositorGpuMs > flBudgetMs;
+	if (bGpuBound && rescaled.flGpuMs + rescaled.flCompositorGpuMs <= flBudgetMs)
+		rescaled.unMissedFrames = 0;
+	return rescaled;
+}
+
+bool CFrameTimingTraceWriter::Open(const std::string& sPath)
+{
+	Close();
+	if (sPath.empty())
+		return false;
+
+	m_file.open(sPath);
+	if (!m_file.is_open())
+		return false;
+	m_file << "frame,scale,gpu_ms,compositor_gpu_ms,cpu_ms,missed\n";
+	return true;
+}
+
+void CFrameTimingTraceWriter::Close()
+{
+	// closing a stream that isn't open sets its fail bit, which would stick to the next one
+	m_file.close();
+	m_file.clear();
+}
+
+void CFrameTimingTraceWriter::Write(float flScale, const FrameTimingSample_t& sample)
+{
+	if (!m_file.is_open())
+		return;
+	m_file << sample.unFrameIndex << ',' << flScale << ',' << sample.flGpuMs << ',' << sample.flCompositorGpuMs << ','
+		<< sample.flCpuMs << ',' << sample.unMissedFrames << '\n';
+}
+
+bool ReadFrameTimingTrace(const std::string& sPath, std::vector<FrameTimingTraceEntry_t>* pvecEntries)
+{
+	std::ifstream file(sPath);
+	if (!file)
+		return false;
+
+	std::string sLine;
+	while (std::getline(file, sLine))
+	{
+		std::replace(sLine.begin(), sLine.end(), ',', ' ');
+		std::istringstream fields(sLine);
+
+		// the header and anything else that isn't a sample line is skipped
+		FrameTimingTraceEntry_t entry;
+		if (fields >> entry.sample.unFrameIndex >> entry.flScale >> entry.sample.flGpuMs >> entry.sample.flCompositorGpuMs
+			>> entry.sample.flCpuMs >> entry.sample.unMissedFrames)
+			pvecEntries->push_back(entry);
+	}
+	return true;
+}
@@ -0,0 +1,126 @@
+#ifndef RENDER_GOVERNOR_H
+#define RENDER_GOVERNOR_H
+
+#pragma once
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// One compositor frame as seen by the governor. Kept free of OpenVR types so
+// recorded traces can be replayed through CRenderGovernor outside of SteamVR.
+struct FrameTimingSample_t
+{
+	uint32_t unFrameIndex;
+	float flGpuMs;				// application GPU time, the part that scales with the render target
+	float flCompositorGpuMs;	// compositor GPU time, the same at any render target size
+	float flCpuMs;				// application CPU time from new poses to frame submit
+	uint32_t unMissedFrames;	// dropped frames plus extra presents of a stale frame
+};
+
+struct RenderGovernorSettings_t
+{
+	float flMinScale = 0.6f;			// per axis, relative to renderWidth/renderHeight
+	float flMaxScale = 1.0f;
+	float flStep = 0.05f;				// scales are quantized to this so small noise can't move them
+	float flTargetLoad = 0.80f;			// fraction of the frame budget a new scale is sized for
+	float flRaiseBelowLoad = 0.65f;		// only grow when the smoothed load is below this...
+	float flLowerAboveLoad = 0.92f;		// ...and only shrink when it is above this
+	float flSmoothing = 0.05f;			// EMA weight of a new sample
+	uint32_t unSettleFrames = 90;		// frames to ignore after a change while the app adapts
+	uint32_t unHoldAfterMissFrames = 45;// minimum spacing of reactions to missed frames
+	uint32_t unNoRaiseAfterMissFrames = 900;// no growing for this long after any missed frame
+};
+
+// --------------------------------------------------------------------------
+// Purpose: Picks the recommended render target scale from compositor frame
+//          timings. The application's GPU cost is modelled as proportional to
+//          the pixel count, i.e. scale squared, the compositor's as fixed, and
+//          a new scale is chosen so the predicted load lands on flTargetLoad.
+//          The gap between flRaiseBelowLoad and flLowerAboveLoad plus the
+//          settle period keep it from oscillating, and so does not growing
+//          again soon after a missed frame: misses the GPU time doesn't
+//          explain would otherwise step the scale down and the load would
+//          take it right back up.
+// --------------------------------------------------------------------------
+class CRenderGovernor
+{
+public:
+	CRenderGovernor();
+
+	// Starts over with new settings. Settings equal to the ones in use change nothing, so
+	// the smoothed timings and holds survive a reload of unrelated driver settings.
+	void Configure(const RenderGovernorSettings_t& settings, float flDisplayFrequency);
+	void Reset();
+
+	// Reset(), but starting from the scale an earlier session ended at, clamped to the range
+	void ResumeAt(float flScale);
+
+	// Returns true when the recommended scale changed
+	bool AddSample(const FrameTimingSample_t& sample);
+
+	float GetScale() const { return m_flScale; }
+	float GetSmoothedGpuMs() const { return m_flGpuMs; }
+	float GetSmoothedCompositorGpuMs() const { return m_flCompositorGpuMs; }
+	float GetSmoothedCpuMs() const { return m_flCpuMs; }
+
+private:
+	float Quantize(float flScale) const;
+	bool SetScale(float flScale);
+
+	bool m_bConfigured;
+	RenderGovernorSettings_t m_settings;
+	float m_flBudgetMs;
+
+	float m_flScale;
+	float m_flGpuMs;
+	float m_flCompositorGpuMs;
+	float m_flCpuMs;
+	bool m_bHaveSample;
+	uint32_t m_unFramesSinceChange;
+	uint32_t m_unFramesSinceMiss;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: The sample a frame rendered at flRenderedScale would have given at
+//          flScale, with the governor's scale^2 model. A miss the GPU time
+//          explains is dropped once the rescaled frame fits the budget; any
+//          other miss stays, whatever the scale. This closes the loop when
+//          the recommended scale isn't the one frames are rendered at, as in
+//          a replayed trace or a running session.
+// --------------------------------------------------------------------------
+extern FrameTimingSample_t RescaleFrameTimingSample(const FrameTimingSample_t& sample, float flRenderedScale, float flScale, float flDisplayFrequency);
+
+// One line of a frame timing trace: a sample and the scale its frame was rendered at
+struct FrameTimingTraceEntry_t
+{
+	float flScale;
+	FrameTimingSample_t sample;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: Records the samples the driver sees to a CSV trace, one line per
+//          frame: frame,scale,gpu_ms,compositor_gpu_ms,cpu_ms,missed. The
+//          scale is the one recommended when the frame's timing arrived;
+//          applications pick a new size up a few frames late, so it is
+//          approximate right after a change.
+// --------------------------------------------------------------------------
+class CFrameTimingTraceWriter
+{
+public:
+	// Closes the current trace and starts a new one; an empty path just closes it
+	bool Open(const std::string& sPath);
+	void Close();
+	bool IsOpen() const { return m_file.is_open(); }
+
+	void Write(float flScale, const FrameTimingSample_t& sample);
+
+private:
+	std::ofstream m_file;
+};
+
+// Reads a trace written by CFrameTimingTraceWriter; returns false if the file can't be read
+extern bool ReadFrameTimingTrace(const std::string& sPath, std::vector<FrameTimingTraceEntry_t>* pvecEntries);
+
+#endif // RENDER_GOVERNOR_H
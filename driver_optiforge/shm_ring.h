@@ -0,0 +1,104 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#endif
+
+// --------------------------------------------------------------------------
+// Shared-memory pose ring for producers running on the same PC as SteamVR.
+//
+// The driver creates a named file mapping "Local\optiforge_pose_<shmName>" and an
+// auto-reset event "Local\optiforge_pose_<shmName>_event". A single producer opens
+// both, claims the ring by storing its process id into unProducerPid (0 -> pid) and
+// then appends records with ShmRing_TryPush. This header only uses fixed-size types
+// and lock-free atomics so any producer can include it as-is.
+// --------------------------------------------------------------------------
+
+static const uint32_t k_unShmRingMagic = 0x4F465242; // 'OFRB'
+static const uint32_t k_unShmRingVersion = 1;
+static const uint32_t k_unShmRingCapacity = 64; // must be a power of two
+
+// A producer that stops refreshing the heartbeat for this long is considered hung
+static const uint32_t k_unShmProducerTimeoutMs = 500;
+
+static const char* const k_pch_ShmMappingPrefix = "Local\\optiforge_pose_";
+static const char* const k_pch_ShmEventSuffix = "_event";
+
+struct ShmPoseRecord_t
+{
+	uint64_t ulTimestampUs;	// producer time, QueryPerformanceCounter converted to microseconds
+	float quat[4];			// x, y, z, w - same order as the TCP packet
+};
+
+struct ShmRingHeader_t
+{
+	uint32_t unMagic;
+	uint32_t unVersion;
+	uint32_t unCapacity;
+	uint32_t unRecordSize;
+
+	// producer owned
+	alignas(64) std::atomic<uint32_t> unProducerPid;	// 0 while no producer is attached
+	std::atomic<uint64_t> ulProducerHeartbeatUs;		// same clock as ShmPoseRecord_t::ulTimestampUs
+	std::atomic<uint64_t> ulWriteIndex;
+
+	// consumer owned
+	alignas(64) std::atomic<uint64_t> ulReadIndex;
+	std::atomic<uint32_t> unConsumerWaiting;			// 1 while the driver is blocked on the event
+};
+
+struct ShmPoseRing_t
+{
+	ShmRingHeader_t header;
+	alignas(64) ShmPoseRecord_t records[k_unShmRingCapacity];
+};
+
+static_assert((k_unShmRingCapacity & (k_unShmRingCapacity - 1)) == 0, "ring capacity must be a power of two");
+static_assert(sizeof(ShmPoseRecord_t) == 24, "ShmPoseRecord_t is part of the shared layout");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared atomics must be lock-free to work across processes");
+
+#if defined( _WIN32 )
+// --------------------------------------------------------------------------
+// Purpose: The clock used for record timestamps and the producer heartbeat
+// --------------------------------------------------------------------------
+inline uint64_t ShmRing_NowUs()
+{
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000ull
+		+ (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000ull / (uint64_t)frequency.QuadPart;
+}
+#endif
+
+// --------------------------------------------------------------------------
+// Purpose: Producer side append. Returns false when the ring is full (the record
+//          is dropped, the driver only ever publishes the newest one anyway).
+//          When *pbWakeConsumer comes back true the producer must SetEvent() the
+//          ring event - this is the only time a syscall is needed.
+// --------------------------------------------------------------------------
+inline bool ShmRing_TryPush(ShmPoseRing_t* pRing, const ShmPoseRecord_t& record, bool* pbWakeConsumer)
+{
+	*pbWakeConsumer = false;
+
+	const uint64_t ulWrite = pRing->header.ulWriteIndex.load(std::memory_order_relaxed);
+	const uint64_t ulRead = pRing->header.ulReadIndex.load(std::memory_order_acquire);
+	if (ulWrite - ulRead >= k_unShmRingCapacity)
+		return false;
+
+	pRing->records[ulWrite & (k_unShmRingCapacity - 1)] = record;
+	pRing->header.ulProducerHeartbeatUs.store(record.ulTimestampUs, std::memory_order_relaxed);
+
+	// seq_cst pairs with the consumer's store to unConsumerWaiting followed by a re-read of ulWriteIndex
+	pRing->header.ulWriteIndex.store(ulWrite + 1, std::memory_order_seq_cst);
+	*pbWakeConsumer = pRing->header.unConsumerWaiting.exchange(0, std::memory_order_seq_cst) != 0;
+	return true;
+}
+
+#endif // SHM_RING_H
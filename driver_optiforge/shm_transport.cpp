@@ -0,0 +1,210 @@
+#include "pch.h"
+#include "shm_transport.h"
+#include "driverlog.h"
+
+// how long to poll the write index before falling back to the event
+static const int k_nShmSpinIterations = 2000;
+
+CShmPoseTransport::CShmPoseTransport()
+{
+	m_hMapping = NULL;
+	m_hEvent = NULL;
+	m_hProducerProcess = NULL;
+	m_pRing = nullptr;
+
+	m_unProducerPid = 0;
+	m_ulPendingReadIndex = 0;
+	m_bProducerAlive = false;
+	m_ulLastHeartbeatUs = 0;
+	m_ulHeartbeatSeenUs = 0;
+}
+
+CShmPoseTransport::~CShmPoseTransport()
+{
+	Close();
+}
+
+bool CShmPoseTransport::Open(const std::string& sName)
+{
+	std::string sMappingName = std::string(k_pch_ShmMappingPrefix) + sName;
+	std::string sEventName = sMappingName + k_pch_ShmEventSuffix;
+
+	m_hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(ShmPoseRing_t), sMappingName.c_str());
+	if (m_hMapping == NULL)
+	{
+		DriverLog("Shared memory mapping %s failed: %d\n", sMappingName.c_str(), GetLastError());
+		return false;
+	}
+	bool bAlreadyExisted = GetLastError() == ERROR_ALREADY_EXISTS;
+
+	m_pRing = (ShmPoseRing_t*)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ShmPoseRing_t));
+	m_hEvent = CreateEventA(NULL, FALSE, FALSE, sEventName.c_str());
+	if (!m_pRing || m_hEvent == NULL)
+	{
+		DriverLog("Shared memory view or event for %s failed: %d\n", sMappingName.c_str(), GetLastError());
+		Close();
+		return false;
+	}
+
+	ShmRingHeader_t& header = m_pRing->header;
+	if (bAlreadyExisted && header.unMagic == k_unShmRingMagic && header.unVersion == k_unShmRingVersion)
+	{
+		// a producer created the section first (or the driver was reloaded); keep its indices
+		DriverLog("Attached to existing shared memory ring %s\n", sMappingName.c_str());
+	}
+	else
+	{
+		// pagefile-backed sections start zeroed, only the constants need filling in
+		header.unCapacity = k_unShmRingCapacity;
+		header.unRecordSize = sizeof(ShmPoseRecord_t);
+		header.unVersion = k_unShmRingVersion;
+		header.ulReadIndex.store(header.ulWriteIndex.load());
+		std::atomic_thread_fence(std::memory_order_release);
+		header.unMagic = k_unShmRingMagic;
+		DriverLog("Created shared memory ring %s\n", sMappingName.c_str());
+	}
+
+	m_ulPendingReadIndex = header.ulReadIndex.load();
+	return true;
+}
+
+void CShmPoseTransport::Close()
+{
+	if (m_hProducerProcess)
+	{
+		CloseHandle(m_hProducerProcess);
+		m_hProducerProcess = NULL;
+	}
+	if (m_pRing)
+	{
+		UnmapViewOfFile(m_pRing);
+		m_pRing = nullptr;
+	}
+	if (m_hEvent)
+	{
+		CloseHandle(m_hEvent);
+		m_hEvent = NULL;
+	}
+	if (m_hMapping)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+	}
+	m_unProducerPid = 0;
+	m_bProducerAlive = false;
+}
+
+const ShmPoseRecord_t* CShmPoseTransport::WaitForLatest(uint32_t unTimeoutMs)
+{
+	ShmRingHeader_t& header = m_pRing->header;
+	const uint64_t ulRead = header.ulReadIndex.load(std::memory_order_relaxed);
+	uint64_t ulWrite = header.ulWriteIndex.load(std::memory_order_acquire);
+
+	for (int i = 0; i < k_nShmSpinIterations && ulWrite == ulRead; i++)
+	{
+		YieldProcessor();
+		ulWrite = header.ulWriteIndex.load(std::memory_order_acquire);
+	}
+
+	if (ulWrite == ulRead)
+	{
+		RefreshProducer(ShmRing_NowUs());
+
+		header.unConsumerWaiting.store(1, std::memory_order_seq_cst);
+		ulWrite = header.ulWriteIndex.load(std::memory_order_seq_cst);
+		if (ulWrite == ulRead)
+		{
+			HANDLE handles[2] = { m_hEvent, m_hProducerProcess };
+			DWORD nHandles = m_hProducerProcess ? 2 : 1;
+			DWORD dwResult = WaitForMultipleObjects(nHandles, handles, FALSE, unTimeoutMs);
+			if (dwResult == WAIT_OBJECT_0 + 1)
+			{
+				DetachProducer("exited");
+			}
+		}
+		header.unConsumerWaiting.store(0, std::memory_order_relaxed);
+
+		ulWrite = header.ulWriteIndex.load(std::memory_order_acquire);
+		if (ulWrite == ulRead)
+			return nullptr;
+	}
+
+	if (!m_bProducerAlive)
+		RefreshProducer(ShmRing_NowUs());
+
+	// everything between ulRead and ulWrite - 1 is superseded by the newest record
+	m_ulPendingReadIndex = ulWrite;
+	return &m_pRing->records[(ulWrite - 1) & (k_unShmRingCapacity - 1)];
+}
+
+void CShmPoseTransport::Consume()
+{
+	m_pRing->header.ulReadIndex.store(m_ulPendingReadIndex, std::memory_order_release);
+}
+
+void CShmPoseTransport::RefreshProducer(uint64_t ulNowUs)
+{
+	ShmRingHeader_t& header = m_pRing->header;
+	uint32_t unPid = header.unProducerPid.load(std::memory_order_acquire);
+
+	if (unPid != m_unProducerPid)
+	{
+		if (m_hProducerProcess)
+		{
+			CloseHandle(m_hProducerProcess);
+			m_hProducerProcess = NULL;
+		}
+		m_unProducerPid = unPid;
+		m_bProducerAlive = false;
+
+		if (unPid != 0)
+		{
+			m_hProducerProcess = OpenProcess(SYNCHRONIZE, FALSE, unPid);
+			if (m_hProducerProcess == NULL)
+			{
+				// the pid is stale, e.g. the producer died before the driver ever saw it
+				DetachProducer("is not running");
+				return;
+			}
+			DriverLog("Shared memory producer %u attached\n", unPid);
+			m_bProducerAlive = true;
+			m_ulLastHeartbeatUs = header.ulProducerHeartbeatUs.load(std::memory_order_relaxed);
+			m_ulHeartbeatSeenUs = ulNowUs;
+		}
+	}
+
+	if (m_unProducerPid == 0)
+		return;
+
+	// a process that is still alive but stopped refreshing its heartbeat is reported as lost,
+	// it becomes alive again as soon as it writes the next record. The heartbeat is on the
+	// producer's clock, which may be skewed against ours, so only a change of it counts and
+	// the timeout runs on our clock from when that change was seen.
+	uint64_t ulHeartbeatUs = header.ulProducerHeartbeatUs.load(std::memory_order_relaxed);
+	if (ulHeartbeatUs != m_ulLastHeartbeatUs)
+	{
+		m_ulLastHeartbeatUs = ulHeartbeatUs;
+		m_ulHeartbeatSeenUs = ulNowUs;
+	}
+	bool bFresh = ulNowUs - m_ulHeartbeatSeenUs < k_unShmProducerTimeoutMs * 1000ull;
+	if (m_bProducerAlive && !bFresh)
+		DriverLog("Shared memory producer %u stopped sending\n", m_unProducerPid);
+	m_bProducerAlive = bFresh;
+}
+
+void CShmPoseTransport::DetachProducer(const char* pchReason)
+{
+	DriverLog("Shared memory producer %u %s\n", m_unProducerPid, pchReason);
+
+	if (m_hProducerProcess)
+	{
+		CloseHandle(m_hProducerProcess);
+		m_hProducerProcess = NULL;
+	}
+
+	// release the claim so a restarted producer can attach
+	uint32_t unExpected = m_unProducerPid;
+	m_pRing->header.unProducerPid.compare_exchange_strong(unExpected, 0);
+	m_unProducerPid = 0;
+	m_bProducerAlive = false;
+}
@@ -0,0 +1,53 @@
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#pragma once
+
+#include <string>
+#include <windows.h>
+#include "shm_ring.h"
+
+// --------------------------------------------------------------------------
+// Purpose: Driver (consumer) side of the shared-memory pose ring.
+//
+//          Records are handed out as pointers into the mapping, so nothing is
+//          copied until the pose pipeline takes the quaternion. While records
+//          keep arriving the consumer only spins on the write index; it blocks on
+//          the ring event (together with the producer's process handle, which is
+//          how a crashed producer is detected) only after the ring ran dry.
+// --------------------------------------------------------------------------
+class CShmPoseTransport
+{
+public:
+	CShmPoseTransport();
+	~CShmPoseTransport();
+
+	bool Open(const std::string& sName);
+	void Close();
+
+	// Returns the newest unread record or nullptr if none arrived within unTimeoutMs.
+	// The record stays valid until Consume() is called.
+	const ShmPoseRecord_t* WaitForLatest(uint32_t unTimeoutMs);
+	void Consume();
+
+	bool IsProducerAlive() const { return m_bProducerAlive; }
+
+private:
+	void RefreshProducer(uint64_t ulNowUs);
+	void DetachProducer(const char* pchReason);
+
+	HANDLE m_hMapping;
+	HANDLE m_hEvent;
+	HANDLE m_hProducerProcess;
+	ShmPoseRing_t* m_pRing;
+
+	uint32_t m_unProducerPid;
+	uint64_t m_ulPendingReadIndex;
+	bool m_bProducerAlive;
+
+	// the producer's heartbeat as last read, and when (on our clock) it was seen to change
+	uint64_t m_ulLastHeartbeatUs;
+	uint64_t m_ulHeartbeatSeenUs;
+};
+
+#endif // SHM_TRANSPORT_H
@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "socket_connect.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+static void SetBlocking(SOCKET sock, bool bBlocking)
+{
+	u_long ulNonBlocking = bBlocking ? 0 : 1;
+	ioctlsocket(sock, FIONBIO, &ulNonBlocking);
+}
+
+bool ConnectSocket(SOCKET sock, const sockaddr_in& addr, const CStopToken* pStop, std::chrono::milliseconds timeout)
+{
+	SetBlocking(sock, false);
+
+	if (connect(sock, (const SOCKADDR*)&addr, sizeof(addr)) == 0)
+	{
+		SetBlocking(sock, true);
+		return true;
+	}
+
+	int nError = WSAGetLastError();
+	if (nError != WSAEWOULDBLOCK)
+	{
+		SetBlocking(sock, true);
+		WSASetLastError(nError);
+		return false;
+	}
+
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+	while (true)
+	{
+		if (pStop && pStop->StopRequested())
+		{
+			nError = WSAEINTR;
+			break;
+		}
+		if (std::chrono::steady_clock::now() >= deadline)
+		{
+			nError = WSAETIMEDOUT;
+			break;
+		}
+
+		// writable once connected, in the except set once the connect failed
+		fd_set writeSet, exceptSet;
+		FD_ZERO(&writeSet);
+		FD_ZERO(&exceptSet);
+		FD_SET(sock, &writeSet);
+		FD_SET(sock, &exceptSet);
+		timeval poll = { 0, 100 * 1000 };
+		int nReady = select(0, nullptr, &writeSet, &exceptSet, &poll);
+		if (nReady == SOCKET_ERROR)
+		{
+			nError = WSAGetLastError();
+			break;
+		}
+		if (nReady == 0)
+			continue;
+
+		int nSocketError = 0;
+		int nLength = sizeof(nSocketError);
+		getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&nSocketError, &nLength);
+		if (FD_ISSET(sock, &exceptSet) || nSocketError != 0)
+		{
+			nError = nSocketError != 0 ? nSocketError : WSAECONNREFUSED;
+			break;
+		}
+
+		SetBlocking(sock, true);
+		return true;
+	}
+
+	SetBlocking(sock, true);
+	WSASetLastError(nError);
+	return false;
+}
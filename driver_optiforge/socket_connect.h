@@ -0,0 +1,24 @@
+#ifndef SOCKET_CONNECT_H
+#define SOCKET_CONNECT_H
+
+#pragma once
+
+#include <chrono>
+#include <winsock2.h>
+#include "thread_runtime.h"
+
+// How long a connect may take before it counts as failed; a blocking connect() to an
+// unreachable host only gives up after about 21 seconds of SYN retries
+static const std::chrono::milliseconds k_connectTimeout(3000);
+
+// --------------------------------------------------------------------------
+// Purpose: connect() that a thread stop can interrupt. The socket is switched
+//          to non-blocking for the connect and polled with select() so a stop
+//          request is noticed within 100 ms, then switched back to blocking.
+//          pStop may be nullptr outside of a runtime thread. On failure the
+//          reason is left in WSAGetLastError(): WSAETIMEDOUT after timeout,
+//          WSAEINTR after a stop, otherwise what the connect failed with.
+// --------------------------------------------------------------------------
+extern bool ConnectSocket(SOCKET sock, const sockaddr_in& addr, const CStopToken* pStop, std::chrono::milliseconds timeout = k_connectTimeout);
+
+#endif // SOCKET_CONNECT_H
@@ -0,0 +1,163 @@
+#include "pch.h"
+#include "thread_runtime.h"
+#include "driverlog.h"
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <strings.h>
+#define _stricmp strcasecmp
+#endif
+
+EThreadPriority ParseThreadPriority(const char* pchPriority)
+{
+	if (!_stricmp(pchPriority, "realtime"))
+		return ThreadPriority_Realtime;
+	if (!_stricmp(pchPriority, "elevated"))
+		return ThreadPriority_Elevated;
+	return ThreadPriority_Normal;
+}
+
+#if defined( _WIN32 )
+typedef HANDLE NativeThread_t;
+
+static void ApplyThreadConfig(NativeThread_t hThread, const ThreadConfig_t& config, bool bSetName)
+{
+	if (bSetName)
+	{
+		wchar_t wszName[64];
+		if (MultiByteToWideChar(CP_UTF8, 0, config.sName.c_str(), -1, wszName, sizeof(wszName) / sizeof(wszName[0])) > 0)
+			SetThreadDescription(hThread, wszName);
+	}
+
+	if (config.ulAffinityMask != 0 && SetThreadAffinityMask(hThread, (DWORD_PTR)config.ulAffinityMask) == 0)
+		DriverLog("Thread %s: affinity 0x%llx failed: %d\n", config.sName.c_str(), config.ulAffinityMask, GetLastError());
+
+	int nPriority = THREAD_PRIORITY_NORMAL;
+	if (config.ePriority == ThreadPriority_Elevated)
+		nPriority = THREAD_PRIORITY_HIGHEST;
+	else if (config.ePriority == ThreadPriority_Realtime)
+		nPriority = THREAD_PRIORITY_TIME_CRITICAL;
+	if (!SetThreadPriority(hThread, nPriority))
+		DriverLog("Thread %s: priority %d failed: %d\n", config.sName.c_str(), nPriority, GetLastError());
+}
+
+static NativeThread_t CurrentNativeThread()
+{
+	return GetCurrentThread();
+}
+#else
+typedef pthread_t NativeThread_t;
+
+static void ApplyThreadConfig(NativeThread_t thread, const ThreadConfig_t& config, bool bSetName)
+{
+	if (bSetName)
+	{
+		// Linux limits names to 15 characters
+		pthread_setname_np(thread, config.sName.substr(0, 15).c_str());
+	}
+
+	if (config.ulAffinityMask != 0)
+	{
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		for (int nCpu = 0; nCpu < 64 && nCpu < CPU_SETSIZE; nCpu++)
+		{
+			if (config.ulAffinityMask & (1ull << nCpu))
+				CPU_SET(nCpu, &cpuSet);
+		}
+		if (pthread_setaffinity_np(thread, sizeof(cpuSet), &cpuSet) != 0)
+			DriverLog("Thread %s: affinity 0x%llx failed\n", config.sName.c_str(), (unsigned long long)config.ulAffinityMask);
+	}
+
+	// without CAP_SYS_NICE this fails and the thread simply keeps its normal priority
+	sched_param param = {};
+	int nPolicy = SCHED_OTHER;
+	if (config.ePriority != ThreadPriority_Normal)
+	{
+		nPolicy = SCHED_FIFO;
+		param.sched_priority = config.ePriority == ThreadPriority_Realtime ? 50 : 1;
+	}
+	if (pthread_setschedparam(thread, nPolicy, &param) != 0)
+		DriverLog("Thread %s: priority %d failed\n", config.sName.c_str(), (int)config.ePriority);
+}
+
+static NativeThread_t CurrentNativeThread()
+{
+	return pthread_self();
+}
+#endif
+
+bool CStopToken::SleepFor(std::chrono::milliseconds duration) const
+{
+	std::unique_lock<std::mutex> lock(m_pState->mutex);
+	return m_pState->cv.wait_for(lock, duration, [this] { return StopRequested(); });
+}
+
+CThreadRuntime::~CThreadRuntime()
+{
+	StopAll();
+}
+
+void CThreadRuntime::Start(const ThreadConfig_t& config, ThreadFunc_t func, WakeFunc_t wake)
+{
+	std::unique_ptr<ManagedThread_t> pThread(new ManagedThread_t());
+	pThread->config = config;
+	pThread->wake = wake;
+
+	ManagedThread_t* pRaw = pThread.get();
+	pThread->thread = std::thread([pRaw, config, func] {
+		ApplyThreadConfig(CurrentNativeThread(), config, true);
+		func(CStopToken(&pRaw->stopState));
+	});
+
+	DriverLog("Started thread %s\n", config.sName.c_str());
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_vecThreads.push_back(std::move(pThread));
+}
+
+void CThreadRuntime::StopAll()
+{
+	std::vector<std::unique_ptr<ManagedThread_t>> vecThreads;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		vecThreads.swap(m_vecThreads);
+	}
+
+	for (auto& pThread : vecThreads)
+	{
+		{
+			std::lock_guard<std::mutex> lock(pThread->stopState.mutex);
+			pThread->stopState.bStop.store(true, std::memory_order_release);
+		}
+		pThread->stopState.cv.notify_all();
+		if (pThread->wake)
+			pThread->wake();
+	}
+
+	for (auto it = vecThreads.rbegin(); it != vecThreads.rend(); ++it)
+	{
+		if ((*it)->thread.joinable())
+			(*it)->thread.join();
+		DriverLog("Stopped thread %s\n", (*it)->config.sName.c_str());
+	}
+}
+
+bool CThreadRuntime::Reconfigure(const ThreadConfig_t& config)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& pThread : m_vecThreads)
+	{
+		if (pThread->config.sName != config.sName)
+			continue;
+
+		pThread->config.ulAffinityMask = config.ulAffinityMask;
+		pThread->config.ePriority = config.ePriority;
+		ApplyThreadConfig(pThread->thread.native_handle(), pThread->config, false);
+		return true;
+	}
+	return false;
+}
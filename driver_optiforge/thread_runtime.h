@@ -0,0 +1,93 @@
+#ifndef THREAD_RUNTIME_H
+#define THREAD_RUNTIME_H
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+enum EThreadPriority
+{
+	ThreadPriority_Normal,
+	ThreadPriority_Elevated,	// above everything SteamVR runs at normal priority
+	ThreadPriority_Realtime,	// time critical; only for short, mostly blocked work like socket reads
+};
+
+extern EThreadPriority ParseThreadPriority(const char* pchPriority);
+
+struct ThreadConfig_t
+{
+	std::string sName;
+	uint64_t ulAffinityMask = 0;	// one bit per logical CPU, 0 leaves placement to the OS
+	EThreadPriority ePriority = ThreadPriority_Normal;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: Handed to every runtime thread. The thread polls StopRequested()
+//          and uses SleepFor() instead of std::this_thread::sleep_for so a
+//          stop doesn't have to wait out the sleep.
+// --------------------------------------------------------------------------
+class CStopToken
+{
+public:
+	struct State_t
+	{
+		std::atomic<bool> bStop{ false };
+		std::mutex mutex;
+		std::condition_variable cv;
+	};
+
+	explicit CStopToken(State_t* pState) : m_pState(pState) {}
+
+	bool StopRequested() const { return m_pState->bStop.load(std::memory_order_acquire); }
+
+	// Returns true if the sleep was cut short by a stop request
+	bool SleepFor(std::chrono::milliseconds duration) const;
+
+private:
+	State_t* m_pState;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: Owns a set of named threads. Each thread gets its name, CPU
+//          affinity and priority applied before its function runs. StopAll()
+//          requests a stop on every thread, runs their wake callbacks so
+//          blocking waits return, and joins them in reverse start order; it
+//          is also called from the destructor, so no thread outlives its owner.
+// --------------------------------------------------------------------------
+class CThreadRuntime
+{
+public:
+	typedef std::function<void(const CStopToken& stop)> ThreadFunc_t;
+	typedef std::function<void()> WakeFunc_t;
+
+	~CThreadRuntime();
+
+	void Start(const ThreadConfig_t& config, ThreadFunc_t func, WakeFunc_t wake = nullptr);
+	void StopAll();
+
+	// Re-applies affinity and priority to a running thread, returns false if there is none by that name
+	bool Reconfigure(const ThreadConfig_t& config);
+
+private:
+	struct ManagedThread_t
+	{
+		ThreadConfig_t config;
+		CStopToken::State_t stopState;
+		WakeFunc_t wake;
+		std::thread thread;
+	};
+
+	std::mutex m_mutex;
+	std::vector<std::unique_ptr<ManagedThread_t>> m_vecThreads;
+};
+
+#endif // THREAD_RUNTIME_H
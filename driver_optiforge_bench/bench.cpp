@@ -0,0 +1,673 @@
+// Microbenchmarks for the driver's hot paths.
+//
+//   driver_optiforge_bench [--json <file>] [--baseline <file>] [--tolerance <percent>] [--filter <name>]
+//
+// Every benchmark is run a number of times and reports the median plus the 10th
+// and 90th percentile of those runs. --json writes the results to a file;
+// --baseline compares the medians against such a file and exits with 1 when
+// anything got slower by more than the tolerance (default 10%). Baselines only
+// mean something on the machine and build they were recorded with; the checked
+// in baseline.json is a Linux g++ reference run, so record one from a Release
+// build before a change and compare after.
+
+#include "../driver_optiforge/pose_state.h"
+#include "../driver_optiforge/pose_packet.h"
+#include "../driver_optiforge/distortion.h"
+#include "../driver_optiforge/pose_math.h"
+#include "../driver_optiforge/frame_codec.h"
+#include "../driver_optiforge/hand_packet.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <math.h>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchResult_t
+{
+	std::string sName;
+	std::string sUnit;
+	double flMedian;
+	double flP10;
+	double flP90;
+};
+
+static const int k_nRuns = 15;
+
+static double NsSince(Clock::time_point start)
+{
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+static BenchResult_t Summarize(const char* pchName, const char* pchUnit, std::vector<double> vecValues)
+{
+	std::sort(vecValues.begin(), vecValues.end());
+	size_t n = vecValues.size();
+
+	BenchResult_t result;
+	result.sName = pchName;
+	result.sUnit = pchUnit;
+	result.flMedian = vecValues[n / 2];
+	result.flP10 = vecValues[n / 10];
+	result.flP90 = vecValues[(n * 9) / 10];
+	return result;
+}
+
+// --------------------------------------------------------------------------
+// GetPose: reads of the pose state plus building the DriverPose_t, while a
+// second thread publishes new orientations as fast as it can
+// --------------------------------------------------------------------------
+static BenchResult_t BenchGetPoseContended()
+{
+	const int k_nIterations = 200000;
+
+	CPoseState poseState;
+	std::atomic<bool> bStop(false);
+	std::thread writer([&] {
+		float quat[4] = { 0.f, 0.f, 0.f, 1.f };
+		while (!bStop.load(std::memory_order_relaxed))
+		{
+			quat[0] += 1.f;
+			poseState.Update(quat, 1);
+		}
+	});
+
+	std::vector<double> vecRuns;
+	double flSink = 0.0;
+	for (int nRun = 0; nRun <= k_nRuns; nRun++)
+	{
+		Clock::time_point start = Clock::now();
+		for (int i = 0; i < k_nIterations; i++)
+		{
+			vr::DriverPose_t pose = BuildHmdPose(poseState.Read(), true, 2);
+			flSink += pose.qRotation.x;
+		}
+		if (nRun > 0) // the first run is warmup
+			vecRuns.push_back(NsSince(start) / k_nIterations);
+	}
+
+	bStop = true;
+	writer.join();
+
+	if (flSink == -1.0)
+		printf(" ");
+	return Summarize("getpose_contended", "ns/op", vecRuns);
+}
+
+// --------------------------------------------------------------------------
+// Packet receive path: a pose stream fed to CPosePacketReader the way recv()
+// returns it from a sender with Nagle off, mostly one packet per call, some
+// coalesced and some split, through ReceivePoseStream as ReceiveTCP does
+// --------------------------------------------------------------------------
+static BenchResult_t BenchPacketParse()
+{
+	const int k_nPackets = 256 * 1024;
+	// repeats every 14 packets
+	const int k_nChunks[] = { 16, 16, 16, 32, 16, 7, 9, 16, 48, 16, 13, 19 };
+	const int k_nChunkCount = sizeof(k_nChunks) / sizeof(k_nChunks[0]);
+
+	std::vector<char> vecStream(k_nPackets * k_nPosePacketSize);
+	for (int i = 0; i < k_nPackets; i++)
+	{
+		float quat[4] = { (float)i, 0.f, 0.f, 1.f };
+		memcpy(&vecStream[i * k_nPosePacketSize], quat, k_nPosePacketSize);
+	}
+
+	std::vector<double> vecRuns;
+	for (int nRun = 0; nRun <= k_nRuns; nRun++)
+	{
+		CPosePacketReader reader;
+		CPoseState poseState;
+		int nParsed = 0;
+		int nChunk = 0;
+
+		Clock::time_point start = Clock::now();
+		for (size_t nOffset = 0; nOffset < vecStream.size(); nChunk = (nChunk + 1) % k_nChunkCount)
+		{
+			int nSize = (int)std::min((size_t)k_nChunks[nChunk], vecStream.size() - nOffset);
+			nParsed += ReceivePoseStream(&reader, &poseState, &vecStream[nOffset], nSize);
+			nOffset += nSize;
+		}
+		double flNs = NsSince(start);
+
+		float flLast = poseState.Read().quat[0];
+		if (nParsed != k_nPackets || flLast != (float)(k_nPackets - 1))
+		{
+			fprintf(stderr, "packet_parse: parsed %d packets, last %f\n", nParsed, flLast);
+			exit(2);
+		}
+		if (nRun > 0)
+			vecRuns.push_back(flNs / k_nPackets);
+	}
+	return Summarize("packet_parse", "ns/packet", vecRuns);
+}
+
+// --------------------------------------------------------------------------
+// Distortion: one full evaluation of a 256x256 vertex mesh per eye
+// --------------------------------------------------------------------------
+static BenchResult_t BenchDistortion()
+{
+	const int k_nGrid = 256;
+
+	std::vector<double> vecRuns;
+	float flSink = 0.f;
+	for (int nRun = 0; nRun <= k_nRuns; nRun++)
+	{
+		Clock::time_point start = Clock::now();
+		for (int nEye = 0; nEye < 2; nEye++)
+		{
+			for (int y = 0; y < k_nGrid; y++)
+			{
+				for (int x = 0; x < k_nGrid; x++)
+				{
+					vr::DistortionCoordinates_t coordinates = ComputeLensDistortion((vr::EVREye)nEye, x / (float)(k_nGrid - 1), y / (float)(k_nGrid - 1));
+					flSink += coordinates.rfRed[0] + coordinates.rfBlue[1];
+				}
+			}
+		}
+		if (nRun > 0)
+			vecRuns.push_back(NsSince(start) / (2.0 * k_nGrid * k_nGrid));
+	}
+
+	if (flSink == -1.f)
+		printf(" ");
+	return Summarize("distortion", "ns/vertex", vecRuns);
+}
+
+// --------------------------------------------------------------------------
+// Quaternion batches: 4096 random unit quaternion pairs in SoA layout. Every
+// run checks the batch results against the scalar reference in pose_math.h.
+// --------------------------------------------------------------------------
+struct QuatBatch_t
+{
+	static const size_t k_nCount = 4096;
+
+	std::vector<float> a[4], b[4], out[4], t;
+	std::vector<posemath::Quatf> vecA, vecB;
+
+	QuatBatch_t()
+	{
+		srand(1);
+		auto Random = [] { return rand() / (float)RAND_MAX * 2.f - 1.f; };
+		for (int c = 0; c < 4; c++)
+		{
+			a[c].resize(k_nCount);
+			b[c].resize(k_nCount);
+			out[c].resize(k_nCount);
+		}
+		t.resize(k_nCount);
+		for (size_t i = 0; i < k_nCount; i++)
+		{
+			posemath::Quatf qa = posemath::Normalize(posemath::Quat(Random(), Random(), Random(), Random()));
+			posemath::Quatf qb = posemath::Normalize(posemath::Quat(Random(), Random(), Random(), Random()));
+			if (i % 8 == 0) // nearly equal pairs take the nlerp path
+				qb = posemath::Normalize(posemath::Add(qa, posemath::Quat(1e-3f, 0.f, 0.f, 0.f)));
+			vecA.push_back(qa);
+			vecB.push_back(qb);
+			t[i] = rand() / (float)RAND_MAX;
+			a[0][i] = qa.w; a[1][i] = qa.x; a[2][i] = qa.y; a[3][i] = qa.z;
+			b[0][i] = qb.w; b[1][i] = qb.x; b[2][i] = qb.y; b[3][i] = qb.z;
+		}
+	}
+
+	posemath::QuatArray_t A() { return posemath::QuatArray_t{ a[0].data(), a[1].data(), a[2].data(), a[3].data() }; }
+	posemath::QuatArray_t B() { return posemath::QuatArray_t{ b[0].data(), b[1].data(), b[2].data(), b[3].data() }; }
+	posemath::QuatArray_t Out() { return posemath::QuatArray_t{ out[0].data(), out[1].data(), out[2].data(), out[3].data() }; }
+
+	// Largest component difference between out and ref(i)
+	template <typename Ref>
+	float MaxError(Ref ref) const
+	{
+		float flMax = 0.f;
+		for (size_t i = 0; i < k_nCount; i++)
+		{
+			posemath::Quatf q = ref(i);
+			flMax = std::max(flMax, std::max(std::max(fabsf(q.w - out[0][i]), fabsf(q.x - out[1][i])), std::max(fabsf(q.y - out[2][i]), fabsf(q.z - out[3][i]))));
+		}
+		return flMax;
+	}
+};
+
+static void CheckBatch(const char* pchName, float flError)
+{
+	if (flError > 1e-5f)
+	{
+		fprintf(stderr, "%s: differs from the scalar reference by %g\n", pchName, flError);
+		exit(2);
+	}
+}
+
+static BenchResult_t BenchQuatMultiplyBatch()
+{
+	QuatBatch_t batch;
+	std::vector<double> vecRuns;
+	for (int nRun = 0; nRun <= k_nRuns; nRun++)
+	{
+		Clock::time_point start = Clock::now();
+		for (int nRepeat = 0; nRepeat < 16; nRepeat++)
+			posemath::MultiplyBatch(batch.A(), batch.B(), batch.Out(), QuatBatch_t::k_nCount);
+		double flNs = NsSince(start);
+
+		CheckBatch("quat_multiply_batch", batch.MaxError([&](size_t i) { return posemath::Multiply(batch.vecA[i], batch.vecB[i]); }));
+		if (nRun > 0)
+			vecRuns.push_back(flNs / (16.0 * QuatBatch_t::k_nCount));
+	}
+	return Summarize("quat_multiply_batch", "ns/quat", vecRuns);
+}
+
+static BenchResult_t BenchQuatSlerpBatch()
+{
+	QuatBatch_t batch;
+	std::vector<double> vecRuns;
+	for (int nRun = 0; nRun <= k_nRuns; nRun++)
+	{
+		Clock::time_point start = Clock::now();
+		for (int nRepeat = 0; nRepeat < 16; nRepeat++)
+			posemath::SlerpBatch(batch.A(), batch.B(), batch.t.data(), batch.Out(), QuatBatch_t::k_nCount);
+		double flNs = NsSince(start);
+
+		CheckBatch("quat_slerp_batch", batch.MaxError([&](size_t i) { return posemath::Slerp(batch.vecA[i], batch.vecB[i], batch.t[i]); }));
+		if (nRun > 0)
+			vecRuns.push_back(flNs / (16.0 * QuatBatch_t::k_nCount));
+	}
+	return Summarize("quat_slerp_batch", "ns/quat", vecRuns);
+}
+
+// The same interpolation one quaternion at a time, for comparison with the batch
+static BenchResult_t BenchQuatSlerpScalar()
+{
+	QuatBatch_t batch;
+	std::vector<double> vecRuns;
+	for (int nRun = 0; nRun <= k_nRuns; nRun++)
+	{
+		Clock::time_point start = Clock::now();
+		for (int nRepeat = 0; nRepeat < 16; nRepeat++)
+		{
+			for (size_t i = 0; i < QuatBatch_t::k_nCount; i++)
+			{
+				posemath::Quatf q = posemath::Slerp(batch.vecA[i], batch.vecB[i], batch.t[i]);
+				batch.out[0][i] = q.w;
+				batch.out[1][i] = q.x;
+				batch.out[2][i] = q.y;
+				batch.out[3][i] = q.z;
+			}
+		}
+		if (nRun > 0)
+			vecRuns.push_back(NsSince(start) / (16.0 * QuatBatch_t::k_nCount));
+	}
+	return Summarize("quat_slerp_scalar", "ns/quat", vecRuns);
+}
+
+// Log followed by Exp must give back the input
+static BenchResult_t BenchQuatLogExpBatch()
+{
+	QuatBatch_t batch;
+	std::vector<float> v[3];
+	for (int c = 0; c < 3; c++)
+		v[c].resize(QuatBatch_t::k_nCount);
+	posemath::Vec3Array_t vecLog = { v[0].data(), v[1].data(), v[2].data() };
+
+	std::vector<double> vecRuns;
+	for (int nRun = 0; nRun <= k_nRuns; nRun++)
+	{
+		Clock::time_point start = Clock::now();
+		for (int nRepeat = 0; nRepeat < 16; nRepeat++)
+		{
+			posemath::LogBatch(batch.A(), vecLog, QuatBatch_t::k_nCount);
+			posemath::ExpBatch(vecLog, batch.Out(), QuatBatch_t::k_nCount);
+		}
+		double flNs = NsSince(start);
+
+		CheckBatch("quat_logexp_batch", batch.MaxError([&](size_t i) { return batch.vecA[i]; }));
+		if (nRun > 0)
+			vecRuns.push_back(flNs / (16.0 * QuatBatch_t::k_nCount));
+	}
+	return Summarize("quat_logexp_batch", "ns/quat", vecRuns);
+}
+
+// --------------------------------------------------------------------------
+// Hand frames: a stream of frames for both hands cut back into messages and
+// their bone rotations unpacked, as the hand link thread does per frame
+// --------------------------------------------------------------------------
+static BenchResult_t BenchHandFrameDecode()
+{
+	const int k_nFrames = 16 * 1024;
+	const int k_nChunk = 1000;
+
+	srand(1);
+	auto Random = [] { return rand() / (float)RAND_MAX * 2.f - 1.f; };
+	std::vector<uint32_t> vecPacked(k_unHandBoneCount);
+	for (uint32_t& unPacked : vecPacked)
+		unPacked = posemath::EncodeSmallestThree(posemath::Normalize(posemath::Quat(Random(), Random(), Random(), Random())));
+
+	std::vector<char> vecStream;
+	for (int i = 0; i < k_nFrames; i++)
+	{
+		HandMessageHeader_t header = { k_unHandMessageMagic, HandMessage_Frame, (uint8_t)(i & 1), sizeof(HandFrame_t) };
+		HandFrame_t frame = {};
+		frame.unSequence = i;
+		frame.ucFlags = HandFrameFlag_Tracked;
+		memcpy(frame.unBoneRotations, vecPacked.data(), sizeof(frame.unBoneRotations));
+		vecStream.insert(vecStream.end(), (const char*)&header, (const char*)&header + sizeof(header));
+		vecStream.insert(vecStream.end(), (const char*)&frame, (const char*)&frame + sizeof(frame));
+	}
+
+	float rotations[4][k_unHandBoneCount];
+	posemath::QuatArray_t out = { rotations[0], rotations[1], rotations[2], rotations[3] };
+
+	std::vector<double> vecRuns;
+	for (int nRun = 0; nRun <= k_nRuns; nRun++)
+	{
+		CHandMessageReader reader;
+		HandFrame_t frame;
+		int nDecoded = 0;
+
+		Clock::time_point start = Clock::now();
+		for (size_t nOffset = 0; nOffset < vecStream.size(); nOffset += k_nChunk)
+		{
+			int nSize = (int)std::min((size_t)k_nChunk, vecStream.size() - nOffset);
+			reader.Feed(&vecStream[nOffset], nSize, [&](const HandMessageHeader_t&, const uint8_t* pPayload) {
+				memcpy(&frame, pPayload, sizeof(frame));
+				posemath::DecodeSmallestThreeBatch(frame.unBoneRotations, out, k_unHandBoneCount);
+				nDecoded++;
+			});
+		}
+		double flNs = NsSince(start);
+
+		if (nDecoded != k_nFrames)
+		{
+			fprintf(stderr, "hand_frame_decode: decoded %d frames\n", nDecoded);
+			exit(2);
+		}
+		float flError = 0.f;
+		for (uint32_t i = 0; i < k_unHandBoneCount; i++)
+		{
+			posemath::Quatf q = posemath::DecodeSmallestThree(vecPacked[i]);
+			flError = std::max(flError, std::max(std::max(fabsf(q.w - rotations[0][i]), fabsf(q.x - rotations[1][i])), std::max(fabsf(q.y - rotations[2][i]), fabsf(q.z - rotations[3][i]))));
+		}
+		CheckBatch("hand_frame_decode", flError);
+		if (nRun > 0)
+			vecRuns.push_back(flNs / k_nFrames);
+	}
+	return Summarize("hand_frame_decode", "ns/frame", vecRuns);
+}
+
+// --------------------------------------------------------------------------
+// Display link slice encoding: synthetic 2160x1200 side-by-side frames cut
+// into the driver's default 4 slices per eye, encoded on this thread and
+// decoded again; the decoded frame must match the source exactly
+// --------------------------------------------------------------------------
+static BenchResult_t BenchFrameEncode()
+{
+	const uint32_t k_unWidth = 2160;
+	const uint32_t k_unHeight = 1200;
+	const uint32_t k_unStride = k_unWidth * k_unFrameBytesPerPixel;
+	const int k_nFrames = 8;
+
+	std::vector<FrameSlice_t> vecSlices = ComputeFrameSlices(k_unWidth, k_unHeight, 4);
+	size_t nMaxSlice = 0;
+	for (const FrameSlice_t& slice : vecSlices)
+		nMaxSlice = std::max(nMaxSlice, MaxEncodedFrameSliceSize(slice.rect));
+
+	std::vector<uint8_t> vecFrame(k_unStride * k_unHeight);
+	std::vector<uint8_t> vecReference(vecFrame.size(), 0);
+	std::vector<uint8_t> vecDecoded(vecFrame.size(), 0);
+	std::vector<uint8_t> vecOutput(nMaxSlice);
+
+	std::vector<double> vecRuns;
+	size_t nEncodedBytes = 0;
+	uint32_t unFrame = 0;
+	for (int nRun = 0; nRun <= k_nRuns; nRun++)
+	{
+		double flNs = 0.0;
+		for (int i = 0; i < k_nFrames; i++, unFrame++)
+		{
+			FillTestFrame(vecFrame.data(), k_unStride, k_unWidth, k_unHeight, unFrame);
+
+			for (size_t nSlice = 0; nSlice < vecSlices.size(); nSlice++)
+			{
+				Clock::time_point start = Clock::now();
+				size_t nSize = EncodeFrameSlice(vecFrame.data(), k_unStride, vecReference.data(), k_unStride, vecSlices[nSlice],
+					unFrame, (uint16_t)nSlice, (uint16_t)vecSlices.size(), 0, unFrame == 0, vecOutput.data());
+				flNs += NsSince(start);
+
+				if (nRun > 0)
+					nEncodedBytes += nSize;
+				if (!DecodeFrameSlice(vecOutput.data(), nSize, vecDecoded.data(), k_unStride, k_unWidth, k_unHeight))
+				{
+					fprintf(stderr, "frame_encode: slice %d of frame %u doesn't decode\n", (int)nSlice, unFrame);
+					exit(2);
+				}
+			}
+
+			if (vecDecoded != vecFrame)
+			{
+				fprintf(stderr, "frame_encode: frame %u decodes differently\n", unFrame);
+				exit(2);
+			}
+		}
+		if (nRun > 0)
+			vecRuns.push_back(flNs / k_nFrames / 1e6);
+	}
+
+	printf("frame_encode: compression %.1f:1\n", (double)vecFrame.size() * k_nFrames * k_nRuns / nEncodedBytes);
+	return Summarize("frame_encode", "ms/frame", vecRuns);
+}
+
+// --------------------------------------------------------------------------
+// Loopback latency: a local sender writes one packet at a time, a receive
+// thread hands every recv() to ReceivePoseStream like ReceiveTCP does, and
+// the time until the pose is readable is recorded
+// --------------------------------------------------------------------------
+static BenchResult_t BenchLoopbackLatency()
+{
+	const int k_nSamples = 2000;
+
+	SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = 0;
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	bind(listener, (sockaddr*)&addr, sizeof(addr));
+	listen(listener, 1);
+
+	socklen_t nAddrLen = sizeof(addr);
+	getsockname(listener, (sockaddr*)&addr, &nAddrLen);
+
+	SOCKET receiver = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (connect(receiver, (sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		fprintf(stderr, "loopback_latency: connect failed\n");
+		exit(2);
+	}
+	SOCKET sender = accept(listener, NULL, NULL);
+	closesocket(listener);
+
+	int nNoDelay = 1;
+	setsockopt(sender, IPPROTO_TCP, TCP_NODELAY, (const char*)&nNoDelay, sizeof(nNoDelay));
+
+	CPoseState poseState;
+	std::thread receiveThread([&] {
+		CPosePacketReader reader;
+		char buffer[64 * k_nPosePacketSize];
+		while (true)
+		{
+			int received = recv(receiver, buffer, sizeof(buffer), 0);
+			if (received <= 0)
+				break;
+			ReceivePoseStream(&reader, &poseState, buffer, received);
+		}
+	});
+
+	std::vector<double> vecSamples;
+	for (int i = 1; i <= k_nSamples + 100; i++)
+	{
+		float quat[4] = { (float)i, 0.f, 0.f, 1.f };
+
+		Clock::time_point start = Clock::now();
+		send(sender, (const char*)quat, k_nPosePacketSize, 0);
+		while (poseState.Read().quat[0] != (float)i)
+		{
+		}
+		if (i > 100) // warmup
+			vecSamples.push_back(NsSince(start) / 1000.0);
+	}
+
+	closesocket(sender);
+	receiveThread.join();
+	closesocket(receiver);
+
+	return Summarize("loopback_latency", "us", vecSamples);
+}
+
+// --------------------------------------------------------------------------
+// Output and baseline comparison
+// --------------------------------------------------------------------------
+static std::string ToJson(const std::vector<BenchResult_t>& vecResults)
+{
+	std::ostringstream out;
+	out << "{\n  \"results\": [\n";
+	for (size_t i = 0; i < vecResults.size(); i++)
+	{
+		const BenchResult_t& r = vecResults[i];
+		out << "    { \"name\": \"" << r.sName << "\", \"unit\": \"" << r.sUnit << "\", \"median\": " << r.flMedian
+			<< ", \"p10\": " << r.flP10 << ", \"p90\": " << r.flP90 << " }" << (i + 1 < vecResults.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+	return out.str();
+}
+
+// Reads the median of every result from a file written by ToJson
+static bool ReadBaseline(const char* pchPath, std::vector<std::pair<std::string, double>>* pvecBaseline)
+{
+	std::ifstream file(pchPath);
+	if (!file)
+		return false;
+
+	std::string sLine;
+	while (std::getline(file, sLine))
+	{
+		size_t nName = sLine.find("\"name\": \"");
+		size_t nMedian = sLine.find("\"median\": ");
+		if (nName == std::string::npos || nMedian == std::string::npos)
+			continue;
+		nName += 9;
+		std::string sName = sLine.substr(nName, sLine.find('"', nName) - nName);
+		pvecBaseline->push_back(std::make_pair(sName, atof(sLine.c_str() + nMedian + 10)));
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* pchJsonPath = NULL;
+	const char* pchBaselinePath = NULL;
+	const char* pchFilter = NULL;
+	double flTolerance = 10.0;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string sArg = argv[i];
+		if (sArg == "--json")
+			pchJsonPath = argv[i + 1];
+		else if (sArg == "--baseline")
+			pchBaselinePath = argv[i + 1];
+		else if (sArg == "--tolerance")
+			flTolerance = atof(argv[i + 1]);
+		else if (sArg == "--filter")
+			pchFilter = argv[i + 1];
+	}
+
+#if defined(_WIN32)
+	WSADATA wsaData;
+	WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+	struct Bench_t { const char* pchName; BenchResult_t(*pFunc)(); };
+	const Bench_t benches[] = {
+		{ "getpose_contended", BenchGetPoseContended },
+		{ "packet_parse", BenchPacketParse },
+		{ "distortion", BenchDistortion },
+		{ "quat_multiply_batch", BenchQuatMultiplyBatch },
+		{ "quat_slerp_batch", BenchQuatSlerpBatch },
+		{ "quat_slerp_scalar", BenchQuatSlerpScalar },
+		{ "quat_logexp_batch", BenchQuatLogExpBatch },
+		{ "hand_frame_decode", BenchHandFrameDecode },
+		{ "frame_encode", BenchFrameEncode },
+		{ "loopback_latency", BenchLoopbackLatency },
+	};
+
+	std::vector<BenchResult_t> vecResults;
+	for (const Bench_t& bench : benches)
+	{
+		if (pchFilter && !strstr(bench.pchName, pchFilter))
+			continue;
+		BenchResult_t result = bench.pFunc();
+		printf("%-20s %12.3f %-10s (p10 %.3f, p90 %.3f)\n", result.sName.c_str(), result.flMedian, result.sUnit.c_str(), result.flP10, result.flP90);
+		vecResults.push_back(result);
+	}
+
+	if (pchJsonPath)
+	{
+		std::ofstream file(pchJsonPath);
+		file << ToJson(vecResults);
+	}
+
+	int nExitCode = 0;
+	if (pchBaselinePath)
+	{
+		std::vector<std::pair<std::string, double>> vecBaseline;
+		if (!ReadBaseline(pchBaselinePath, &vecBaseline))
+		{
+			fprintf(stderr, "Unable to read baseline %s\n", pchBaselinePath);
+			return 2;
+		}
+
+		printf("\nagainst %s (tolerance %.1f%%):\n", pchBaselinePath, flTolerance);
+		for (const BenchResult_t& result : vecResults)
+		{
+			for (const auto& baseline : vecBaseline)
+			{
+				if (baseline.first != result.sName || baseline.second <= 0.0)
+					continue;
+
+				// every metric is "lower is better"
+				double flChange = (result.flMedian - baseline.second) / baseline.second * 100.0;
+				bool bRegressed = flChange > flTolerance;
+				printf("%-20s %+8.1f%%%s\n", result.sName.c_str(), flChange, bRegressed ? "  REGRESSION" : "");
+				if (bRegressed)
+					nExitCode = 1;
+			}
+		}
+	}
+
+#if defined(_WIN32)
+	WSACleanup();
+#endif
+	return nExitCode;
+}
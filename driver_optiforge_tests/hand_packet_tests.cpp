@@ -0,0 +1,217 @@
+#include "tests.h"
+#include "../driver_optiforge/hand_packet.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------------------------
+// CHandMessageReader: whole messages come out whatever the recv() chunking,
+// and a damaged stream costs at most the messages it overlaps.
+// --------------------------------------------------------------------------
+struct ReceivedMessage_t
+{
+	uint8_t ucType;
+	uint8_t ucHand;
+	uint32_t unSequence;		// frames only
+	float flFirstBone;			// calibrations only
+};
+
+static void AppendMessage(std::vector<char>* pvecStream, uint32_t unMagic, uint8_t ucType, uint8_t ucHand, const void* pPayload, uint16_t usPayloadSize)
+{
+	HandMessageHeader_t header = { unMagic, ucType, ucHand, usPayloadSize };
+	const char* pHeader = (const char*)&header;
+	pvecStream->insert(pvecStream->end(), pHeader, pHeader + sizeof(header));
+	pvecStream->insert(pvecStream->end(), (const char*)pPayload, (const char*)pPayload + usPayloadSize);
+}
+
+static void AppendFrame(std::vector<char>* pvecStream, uint32_t unSequence, uint8_t ucHand = 0)
+{
+	HandFrame_t frame = {};
+	frame.unSequence = unSequence;
+	frame.ucFlags = HandFrameFlag_Tracked;
+	AppendMessage(pvecStream, k_unHandMessageMagic, HandMessage_Frame, ucHand, &frame, sizeof(frame));
+}
+
+static void AppendCalibration(std::vector<char>* pvecStream, float flFirstBone, uint8_t ucHand = 1)
+{
+	HandCalibration_t calibration = {};
+	calibration.bonePositions[0][0] = flFirstBone;
+	calibration.bonePositions[k_unHandBoneCount - 1][2] = -flFirstBone;
+	AppendMessage(pvecStream, k_unHandMessageMagic, HandMessage_Calibration, ucHand, &calibration, sizeof(calibration));
+}
+
+// Feeds the stream in chunks of the given sizes, repeating the last one, and collects what comes out
+static std::vector<ReceivedMessage_t> FeedStream(CHandMessageReader* pReader, const std::vector<char>& vecStream, const std::vector<int>& vecChunks)
+{
+	std::vector<ReceivedMessage_t> vecReceived;
+	auto handler = [&vecReceived](const HandMessageHeader_t& header, const uint8_t* pPayload) {
+		ReceivedMessage_t message = { header.ucType, header.ucHand, 0, 0.f };
+		if (header.ucType == HandMessage_Frame)
+		{
+			HandFrame_t frame;
+			memcpy(&frame, pPayload, sizeof(frame));
+			message.unSequence = frame.unSequence;
+		}
+		else
+		{
+			HandCalibration_t calibration;
+			memcpy(&calibration, pPayload, sizeof(calibration));
+			message.flFirstBone = calibration.bonePositions[0][0];
+			TEST_CHECK(calibration.bonePositions[k_unHandBoneCount - 1][2] == -message.flFirstBone);
+		}
+		vecReceived.push_back(message);
+	};
+
+	size_t nOffset = 0;
+	for (size_t nChunk = 0; nOffset < vecStream.size(); nChunk++)
+	{
+		int nSize = vecChunks[std::min(nChunk, vecChunks.size() - 1)];
+		nSize = (int)std::min((size_t)nSize, vecStream.size() - nOffset);
+		pReader->Feed(&vecStream[nOffset], nSize, handler);
+		nOffset += nSize;
+	}
+	return vecReceived;
+}
+
+static std::vector<ReceivedMessage_t> FeedStream(const std::vector<char>& vecStream, const std::vector<int>& vecChunks)
+{
+	CHandMessageReader reader;
+	return FeedStream(&reader, vecStream, vecChunks);
+}
+
+static std::vector<uint32_t> FrameSequences(const std::vector<ReceivedMessage_t>& vecReceived)
+{
+	std::vector<uint32_t> vecSequences;
+	for (const ReceivedMessage_t& message : vecReceived)
+	{
+		if (message.ucType == HandMessage_Frame)
+			vecSequences.push_back(message.unSequence);
+	}
+	return vecSequences;
+}
+
+static void TestCalibrationAndFrames()
+{
+	std::vector<char> vecStream;
+	AppendCalibration(&vecStream, 0.25f, 1);
+	AppendFrame(&vecStream, 1, 0);
+	AppendFrame(&vecStream, 2, 1);
+
+	std::vector<ReceivedMessage_t> vecReceived = FeedStream(vecStream, { (int)vecStream.size() });
+	TEST_CHECK(vecReceived.size() == 3);
+	if (vecReceived.size() == 3)
+	{
+		TEST_CHECK(vecReceived[0].ucType == HandMessage_Calibration && vecReceived[0].ucHand == 1);
+		TEST_CHECK(vecReceived[0].flFirstBone == 0.25f);
+		TEST_CHECK(vecReceived[1].ucType == HandMessage_Frame && vecReceived[1].ucHand == 0 && vecReceived[1].unSequence == 1);
+		TEST_CHECK(vecReceived[2].ucType == HandMessage_Frame && vecReceived[2].ucHand == 1 && vecReceived[2].unSequence == 2);
+	}
+
+	// a calibration is larger than a typical recv() chunk and has to be put together again
+	vecReceived = FeedStream(vecStream, { 100 });
+	TEST_CHECK(vecReceived.size() == 3 && vecReceived[0].flFirstBone == 0.25f);
+}
+
+static void TestSplitAcrossChunks()
+{
+	std::vector<char> vecStream;
+	AppendFrame(&vecStream, 7);
+	AppendFrame(&vecStream, 8);
+
+	// every split point of the first message, the header included
+	size_t nFirstMessage = sizeof(HandMessageHeader_t) + sizeof(HandFrame_t);
+	for (size_t nSplit = 1; nSplit < nFirstMessage; nSplit++)
+	{
+		std::vector<ReceivedMessage_t> vecReceived = FeedStream(vecStream, { (int)nSplit, (int)vecStream.size() });
+		std::vector<uint32_t> vecSequences = FrameSequences(vecReceived);
+		if (vecSequences != std::vector<uint32_t>{ 7, 8 })
+		{
+			fprintf(stderr, "split after %u bytes: got %u frames\n", (uint32_t)nSplit, (uint32_t)vecSequences.size());
+			g_nFailedChecks++;
+		}
+	}
+
+	// one byte at a time, and a header spread over three calls
+	TEST_CHECK(FrameSequences(FeedStream(vecStream, { 1 })) == (std::vector<uint32_t>{ 7, 8 }));
+	TEST_CHECK(FrameSequences(FeedStream(vecStream, { 3, 2, 3, 1000 })) == (std::vector<uint32_t>{ 7, 8 }));
+}
+
+static void TestInvalidHeaders()
+{
+	HandFrame_t frame = {};
+	frame.unSequence = 99;
+	HandCalibration_t calibration = {};
+
+	std::vector<char> vecStream;
+	AppendFrame(&vecStream, 1);
+	AppendMessage(&vecStream, k_unHandMessageMagic ^ 0x01000000, HandMessage_Frame, 0, &frame, sizeof(frame));		// bad magic
+	AppendFrame(&vecStream, 2);
+	AppendMessage(&vecStream, k_unHandMessageMagic, HandMessage_Frame, 0, &calibration, sizeof(calibration));		// calibration size for a frame
+	AppendFrame(&vecStream, 3);
+	AppendMessage(&vecStream, k_unHandMessageMagic, HandMessage_Calibration, 0, &frame, sizeof(frame));				// frame size for a calibration
+	AppendFrame(&vecStream, 4);
+	AppendMessage(&vecStream, k_unHandMessageMagic, HandMessage_Frame, 2, &frame, sizeof(frame));					// no third hand
+	AppendFrame(&vecStream, 5);
+	AppendMessage(&vecStream, k_unHandMessageMagic, 3, 0, &frame, sizeof(frame));									// unknown type
+	AppendFrame(&vecStream, 6);
+
+	for (int nChunk : { 1, 13, 160, 4096 })
+	{
+		std::vector<uint32_t> vecSequences = FrameSequences(FeedStream(vecStream, { nChunk }));
+		if (vecSequences != std::vector<uint32_t>{ 1, 2, 3, 4, 5, 6 })
+		{
+			fprintf(stderr, "invalid headers, %d byte chunks: got %u frames\n", nChunk, (uint32_t)vecSequences.size());
+			g_nFailedChecks++;
+		}
+	}
+}
+
+static void TestCorruptedStream()
+{
+	std::mt19937 rng(33);
+	std::uniform_int_distribution<int> byteDist(0, 255);
+
+	std::vector<char> vecStream;
+	AppendFrame(&vecStream, 1);
+
+	// noise, more of it than the reader buffers
+	for (int i = 0; i < 5000; i++)
+		vecStream.push_back((char)byteDist(rng));
+	AppendFrame(&vecStream, 2);
+
+	// a frame cut off halfway: its header swallows the start of frame 4 as the rest of its
+	// payload, which can't be told from a real frame, and what is left of 4 is skipped
+	std::vector<char> vecTruncated;
+	AppendFrame(&vecTruncated, 3);
+	vecStream.insert(vecStream.end(), vecTruncated.begin(), vecTruncated.begin() + vecTruncated.size() / 2);
+	for (uint32_t unSequence = 4; unSequence <= 10; unSequence++)
+		AppendFrame(&vecStream, unSequence);
+
+	for (int nChunk : { 1, 7, 64, 1500, 100000 })
+	{
+		std::vector<uint32_t> vecSequences = FrameSequences(FeedStream(vecStream, { nChunk }));
+		std::vector<uint32_t> vecExpected = { 1, 2, 3, 5, 6, 7, 8, 9, 10 };
+		if (vecSequences != vecExpected)
+		{
+			fprintf(stderr, "corrupted stream, %d byte chunks: got %u frames\n", nChunk, (uint32_t)vecSequences.size());
+			g_nFailedChecks++;
+		}
+	}
+
+	// Reset() drops a partial message, as after a reconnect
+	CHandMessageReader reader;
+	FeedStream(&reader, std::vector<char>(vecTruncated.begin(), vecTruncated.begin() + 20), { 20 });
+	reader.Reset();
+	std::vector<char> vecClean;
+	AppendFrame(&vecClean, 11);
+	TEST_CHECK(FrameSequences(FeedStream(&reader, vecClean, { 1000 })) == (std::vector<uint32_t>{ 11 }));
+}
+
+void TestHandPacket()
+{
+	TestCalibrationAndFrames();
+	TestSplitAcrossChunks();
+	TestInvalidHeaders();
+	TestCorruptedStream();
+}
@@ -0,0 +1,312 @@
+#include "tests.h"
+#include "../driver_optiforge/pose_math.h"
+
+#include <algorithm>
+#include <random>
+#include <string.h>
+#include <vector>
+
+using namespace posemath;
+
+// --------------------------------------------------------------------------
+// Every *Batch kernel against its scalar reference, for lengths around the
+// register width so both the full blocks and the padded tail are covered.
+// Outputs get a few guard elements past n that must stay untouched.
+// --------------------------------------------------------------------------
+static const size_t k_nGuard = 3;
+static const float k_flGuard = 12345.f;
+
+// the polynomial atan2/sincos of the SIMD paths against the C runtime's
+static const float k_flTranscendentalTolerance = 1e-5f;
+static const float k_flArithmeticTolerance = 2e-6f;
+
+static std::vector<size_t> BatchLengths()
+{
+	const size_t w = (size_t)simd::k_nWidth;
+	std::vector<size_t> vecLengths = { 0, 1, 2, 3, w - 1, w, w + 1, 2 * w - 1, 2 * w, 2 * w + 3, 61 };
+	std::sort(vecLengths.begin(), vecLengths.end());
+	vecLengths.erase(std::unique(vecLengths.begin(), vecLengths.end()), vecLengths.end());
+	return vecLengths;
+}
+
+struct QuatBuffer_t
+{
+	std::vector<float> w, x, y, z;
+
+	explicit QuatBuffer_t(size_t n) : w(n + k_nGuard, k_flGuard), x(n + k_nGuard, k_flGuard), y(n + k_nGuard, k_flGuard), z(n + k_nGuard, k_flGuard) {}
+
+	QuatArray_t View() { return QuatArray_t{ w.data(), x.data(), y.data(), z.data() }; }
+	Quatf Get(size_t i) const { return Quat(w[i], x[i], y[i], z[i]); }
+	void Set(size_t i, const Quatf& q) { w[i] = q.w; x[i] = q.x; y[i] = q.y; z[i] = q.z; }
+
+	bool GuardIntact(size_t n) const
+	{
+		for (size_t i = n; i < n + k_nGuard; i++)
+		{
+			if (w[i] != k_flGuard || x[i] != k_flGuard || y[i] != k_flGuard || z[i] != k_flGuard)
+				return false;
+		}
+		return true;
+	}
+};
+
+struct Vec3Buffer_t
+{
+	std::vector<float> x, y, z;
+
+	explicit Vec3Buffer_t(size_t n) : x(n + k_nGuard, k_flGuard), y(n + k_nGuard, k_flGuard), z(n + k_nGuard, k_flGuard) {}
+
+	Vec3Array_t View() { return Vec3Array_t{ x.data(), y.data(), z.data() }; }
+	Vec3f Get(size_t i) const { return Vec3f{ x[i], y[i], z[i] }; }
+	void Set(size_t i, const Vec3f& v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+
+	bool GuardIntact(size_t n) const
+	{
+		for (size_t i = n; i < n + k_nGuard; i++)
+		{
+			if (x[i] != k_flGuard || y[i] != k_flGuard || z[i] != k_flGuard)
+				return false;
+		}
+		return true;
+	}
+};
+
+static float QuatError(const Quatf& a, const Quatf& b)
+{
+	return std::max(std::max(fabsf(a.w - b.w), fabsf(a.x - b.x)), std::max(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+}
+
+static float Vec3Error(const Vec3f& a, const Vec3f& b)
+{
+	return std::max(std::max(fabsf(a.x - b.x), fabsf(a.y - b.y)), fabsf(a.z - b.z));
+}
+
+static void CheckKernel(const char* pchKernel, size_t n, float flMaxError, float flTolerance, bool bGuardIntact)
+{
+	if (!(flMaxError <= flTolerance))
+	{
+		fprintf(stderr, "%s, n = %u: differs from the scalar reference by %g\n", pchKernel, (uint32_t)n, flMaxError);
+		g_nFailedChecks++;
+	}
+	if (!bGuardIntact)
+	{
+		fprintf(stderr, "%s, n = %u: wrote past the end of the output\n", pchKernel, (uint32_t)n);
+		g_nFailedChecks++;
+	}
+}
+
+// Unit quaternions with the corner cases the kernels branch on mixed in: identity,
+// negative w (rotations past pi for Log) and a single axis
+static Quatf TestQuat(std::mt19937& rng, size_t i)
+{
+	switch (i % 7)
+	{
+	case 0: return Identity();
+	case 3: return Quat(-0.2f, 0.f, 0.f, -0.98f);
+	default: break;
+	}
+	std::uniform_real_distribution<float> dist(-1.f, 1.f);
+	return Normalize(Quat(dist(rng), dist(rng), dist(rng), dist(rng)));
+}
+
+static void TestMultiplyBatch(std::mt19937& rng, size_t n)
+{
+	QuatBuffer_t a(n), b(n), out(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		a.Set(i, TestQuat(rng, i));
+		b.Set(i, TestQuat(rng, i + 1));
+	}
+
+	MultiplyBatch(a.View(), b.View(), out.View(), n);
+	float flError = 0.f;
+	for (size_t i = 0; i < n; i++)
+		flError = std::max(flError, QuatError(out.Get(i), Multiply(a.Get(i), b.Get(i))));
+	CheckKernel("MultiplyBatch", n, flError, k_flArithmeticTolerance, out.GuardIntact(n));
+
+	// the output may alias an input
+	QuatBuffer_t reference = a;
+	MultiplyBatch(a.View(), b.View(), a.View(), n);
+	flError = 0.f;
+	for (size_t i = 0; i < n; i++)
+		flError = std::max(flError, QuatError(a.Get(i), Multiply(reference.Get(i), b.Get(i))));
+	CheckKernel("MultiplyBatch in place", n, flError, k_flArithmeticTolerance, a.GuardIntact(n));
+}
+
+static void TestNormalizeBatch(std::mt19937& rng, size_t n)
+{
+	std::uniform_real_distribution<float> dist(-3.f, 3.f);
+	QuatBuffer_t q(n), out(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		// zero length becomes the identity in both
+		if (i % 5 == 2)
+			q.Set(i, Quat(0.f, 0.f, 0.f, 0.f));
+		else
+			q.Set(i, Quat(dist(rng), dist(rng), dist(rng), dist(rng)));
+	}
+
+	NormalizeBatch(q.View(), out.View(), n);
+	float flError = 0.f;
+	for (size_t i = 0; i < n; i++)
+		flError = std::max(flError, QuatError(out.Get(i), Normalize(q.Get(i))));
+	CheckKernel("NormalizeBatch", n, flError, k_flArithmeticTolerance, out.GuardIntact(n));
+
+	QuatBuffer_t reference = q;
+	NormalizeBatch(q.View(), q.View(), n);
+	flError = 0.f;
+	for (size_t i = 0; i < n; i++)
+		flError = std::max(flError, QuatError(q.Get(i), Normalize(reference.Get(i))));
+	CheckKernel("NormalizeBatch in place", n, flError, k_flArithmeticTolerance, q.GuardIntact(n));
+}
+
+static void TestSlerpBatch(std::mt19937& rng, size_t n)
+{
+	std::uniform_real_distribution<float> distT(0.f, 1.f);
+	QuatBuffer_t a(n), b(n), out(n);
+	std::vector<float> t(n + k_nGuard);
+	for (size_t i = 0; i < n; i++)
+	{
+		Quatf qa = TestQuat(rng, i);
+		Quatf qb = TestQuat(rng, i + 2);
+		if (i % 4 == 1)
+			qb = Normalize(Add(qa, Quat(1e-3f, -1e-3f, 0.f, 1e-3f)));	// nearly equal: the lerp branch
+		else if (i % 4 == 2)
+			qb = Scale(qb, -1.f);										// the other hemisphere: b is flipped
+		a.Set(i, qa);
+		b.Set(i, qb);
+		t[i] = (i % 6 == 0) ? (float)(i % 12 == 0) : distT(rng);		// including both ends
+	}
+
+	SlerpBatch(a.View(), b.View(), t.data(), out.View(), n);
+	float flError = 0.f;
+	for (size_t i = 0; i < n; i++)
+		flError = std::max(flError, QuatError(out.Get(i), Slerp(a.Get(i), b.Get(i), t[i])));
+	CheckKernel("SlerpBatch", n, flError, k_flTranscendentalTolerance, out.GuardIntact(n));
+}
+
+static void TestLogExpBatch(std::mt19937& rng, size_t n)
+{
+	QuatBuffer_t q(n);
+	Vec3Buffer_t log(n);
+	for (size_t i = 0; i < n; i++)
+		q.Set(i, TestQuat(rng, i));
+
+	LogBatch(q.View(), log.View(), n);
+	float flError = 0.f;
+	for (size_t i = 0; i < n; i++)
+		flError = std::max(flError, Vec3Error(log.Get(i), Log(q.Get(i))));
+	CheckKernel("LogBatch", n, flError, k_flTranscendentalTolerance, log.GuardIntact(n));
+
+	// Exp on its own inputs: all of |v| <= pi, down to zero and below the small-angle cutoff
+	std::uniform_real_distribution<float> dist(-1.f, 1.f);
+	Vec3Buffer_t v(n);
+	QuatBuffer_t exp(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		Vec3f axis = { dist(rng), dist(rng), dist(rng) };
+		float flLength = sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+		float flAngle = 3.14159265f * i / (n > 1 ? n - 1 : 1);
+		if (i % 5 == 4)
+			flAngle = 1e-8f;
+		float k = flLength > 0.f ? flAngle / flLength : 0.f;
+		v.Set(i, Vec3f{ axis.x * k, axis.y * k, axis.z * k });
+	}
+
+	ExpBatch(v.View(), exp.View(), n);
+	flError = 0.f;
+	for (size_t i = 0; i < n; i++)
+		flError = std::max(flError, QuatError(exp.Get(i), Exp(v.Get(i))));
+	CheckKernel("ExpBatch", n, flError, k_flTranscendentalTolerance, exp.GuardIntact(n));
+}
+
+static void TestDecodeSmallestThreeBatch(std::mt19937& rng, size_t n)
+{
+	std::vector<uint32_t> vecPacked(n);
+	for (size_t i = 0; i < n; i++)
+		vecPacked[i] = EncodeSmallestThree(TestQuat(rng, i));
+
+	// every position of the largest component, whatever the random ones came out as
+	for (size_t i = 0; i < n && i < 4; i++)
+	{
+		float c[4] = { 0.1f, -0.2f, 0.3f, 0.1f };
+		c[i] = -0.9f;
+		vecPacked[i] = EncodeSmallestThree(Normalize(Quat(c[3], c[0], c[1], c[2])));
+	}
+
+	QuatBuffer_t out(n);
+	DecodeSmallestThreeBatch(vecPacked.data(), out.View(), n);
+	float flError = 0.f;
+	for (size_t i = 0; i < n; i++)
+		flError = std::max(flError, QuatError(out.Get(i), DecodeSmallestThree(vecPacked[i])));
+	CheckKernel("DecodeSmallestThreeBatch", n, flError, k_flArithmeticTolerance, out.GuardIntact(n));
+}
+
+static void TestToHmdMatrix34Batch(std::mt19937& rng, size_t n)
+{
+	std::uniform_real_distribution<float> dist(-2.f, 2.f);
+	QuatBuffer_t q(n);
+	Vec3Buffer_t pos(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		q.Set(i, TestQuat(rng, i));
+		pos.Set(i, Vec3f{ dist(rng), dist(rng), dist(rng) });
+	}
+
+	for (int nWithPos = 0; nWithPos < 2; nWithPos++)
+	{
+		vr::HmdMatrix34_t guard;
+		for (int r = 0; r < 3; r++)
+		{
+			for (int c = 0; c < 4; c++)
+				guard.m[r][c] = k_flGuard;
+		}
+		std::vector<vr::HmdMatrix34_t> vecOut(n + k_nGuard, guard);
+
+		Vec3Array_t posView = pos.View();
+		ToHmdMatrix34Batch(q.View(), nWithPos ? &posView : nullptr, vecOut.data(), n);
+
+		float flError = 0.f;
+		for (size_t i = 0; i < n; i++)
+		{
+			vr::HmdMatrix34_t expected = ToHmdMatrix34(q.Get(i), nWithPos ? pos.Get(i) : Vec3f{ 0.f, 0.f, 0.f });
+			for (int r = 0; r < 3; r++)
+			{
+				for (int c = 0; c < 4; c++)
+					flError = std::max(flError, fabsf(vecOut[i].m[r][c] - expected.m[r][c]));
+			}
+		}
+
+		bool bGuardIntact = true;
+		for (size_t i = n; i < n + k_nGuard; i++)
+			bGuardIntact = bGuardIntact && memcmp(&vecOut[i], &guard, sizeof(guard)) == 0;
+
+		CheckKernel(nWithPos ? "ToHmdMatrix34Batch" : "ToHmdMatrix34Batch without position", n, flError, k_flArithmeticTolerance, bGuardIntact);
+	}
+}
+
+// --------------------------------------------------------------------------
+// The arithmetic-only functions are constexpr and usable in constant
+// expressions; this fails to compile if one of them stops being so
+// --------------------------------------------------------------------------
+static constexpr Quatf k_quarterTurnZ = Quat(0.70710677f, 0.f, 0.f, 0.70710677f);
+static constexpr Quatf k_halfTurnZ = Multiply(k_quarterTurnZ, k_quarterTurnZ);
+static_assert(Dot(Multiply(Identity(), k_quarterTurnZ), k_quarterTurnZ) > 0.9999f, "Multiply by the identity");
+static_assert(k_halfTurnZ.w < 1e-6f && k_halfTurnZ.z > 0.9999f, "two quarter turns make a half turn");
+static_assert(Multiply(k_quarterTurnZ, Conjugate(k_quarterTurnZ)).w > 0.9999f, "q * q^-1");
+static_assert(Rotate(k_quarterTurnZ, Vec3f{ 1.f, 0.f, 0.f }).y > 0.9999f, "a quarter turn about z takes x to y");
+static_assert(Add(Scale(k_quarterTurnZ, 2.f), Scale(k_quarterTurnZ, -1.f)).z == k_quarterTurnZ.z, "Scale and Add");
+
+void TestPoseMath()
+{
+	std::mt19937 rng(31);
+	for (size_t n : BatchLengths())
+	{
+		TestMultiplyBatch(rng, n);
+		TestNormalizeBatch(rng, n);
+		TestSlerpBatch(rng, n);
+		TestLogExpBatch(rng, n);
+		TestDecodeSmallestThreeBatch(rng, n);
+		TestToHmdMatrix34Batch(rng, n);
+	}
+}
@@ -0,0 +1,104 @@
+#include "tests.h"
+#include "../driver_optiforge/pose_packet.h"
+
+#include <algorithm>
+#include <vector>
+
+// --------------------------------------------------------------------------
+// ReceivePoseStream: TCP keeps no write boundaries, so a pose can arrive
+// split over several recv() calls or several of them in one; every pose
+// must be counted and the newest complete one published.
+// --------------------------------------------------------------------------
+static std::vector<char> MakePoseStream(int nPackets)
+{
+	std::vector<char> vecStream(nPackets * k_nPosePacketSize);
+	for (int i = 0; i < nPackets; i++)
+	{
+		float quat[4] = { (float)(i + 1), 0.5f, -0.5f, 1.f };
+		memcpy(&vecStream[i * k_nPosePacketSize], quat, k_nPosePacketSize);
+	}
+	return vecStream;
+}
+
+// Feeds the stream in chunks of the given sizes, repeating the last one. Returns the packets
+// completed and checks that the published pose is always the newest complete packet.
+static int FeedPoseStream(CPosePacketReader* pReader, CPoseState* pPoseState, const std::vector<char>& vecStream, const std::vector<int>& vecChunks)
+{
+	int nPackets = 0;
+	size_t nOffset = 0;
+	for (size_t nChunk = 0; nOffset < vecStream.size(); nChunk++)
+	{
+		int nSize = vecChunks[std::min(nChunk, vecChunks.size() - 1)];
+		nSize = (int)std::min((size_t)nSize, vecStream.size() - nOffset);
+		nPackets += ReceivePoseStream(pReader, pPoseState, &vecStream[nOffset], nSize);
+		nOffset += nSize;
+
+		PoseSample_t sample = pPoseState->Read();
+		float flNewest = (float)(nOffset / k_nPosePacketSize);
+		if (nOffset >= (size_t)k_nPosePacketSize && (sample.quat[0] != flNewest || sample.quat[3] != 1.f))
+		{
+			fprintf(stderr, "after %u bytes: pose %g published, expected %g\n", (uint32_t)nOffset, sample.quat[0], flNewest);
+			g_nFailedChecks++;
+			break;
+		}
+	}
+	return nPackets;
+}
+
+static int FeedPoseStream(const std::vector<char>& vecStream, const std::vector<int>& vecChunks, float* pflLast)
+{
+	CPosePacketReader reader;
+	CPoseState poseState;
+	int nPackets = FeedPoseStream(&reader, &poseState, vecStream, vecChunks);
+	*pflLast = poseState.Read().quat[0];
+	return nPackets;
+}
+
+static void TestPoseFraming()
+{
+	std::vector<char> vecStream = MakePoseStream(40);
+	float flLast = 0.f;
+
+	// one packet per read, as a sender with Nagle off mostly delivers them
+	TEST_CHECK(FeedPoseStream(vecStream, { k_nPosePacketSize }, &flLast) == 40 && flLast == 40.f);
+
+	// a backlog that queued up while the thread was descheduled, drained in one read
+	TEST_CHECK(FeedPoseStream(vecStream, { (int)vecStream.size() }, &flLast) == 40 && flLast == 40.f);
+
+	// every split point of a packet, and reads that cover a packet end and the start of the next
+	for (int nSplit = 1; nSplit < k_nPosePacketSize; nSplit++)
+	{
+		int nPackets = FeedPoseStream(vecStream, { nSplit, k_nPosePacketSize }, &flLast);
+		if (nPackets != 40 || flLast != 40.f)
+		{
+			fprintf(stderr, "split after %d bytes: %d packets, last %g\n", nSplit, nPackets, flLast);
+			g_nFailedChecks++;
+		}
+	}
+	TEST_CHECK(FeedPoseStream(vecStream, { 1 }, &flLast) == 40 && flLast == 40.f);
+	TEST_CHECK(FeedPoseStream(vecStream, { 7, 9, 16, 48, 13, 19 }, &flLast) == 40 && flLast == 40.f);
+	TEST_CHECK(FeedPoseStream(vecStream, { 33 }, &flLast) == 40 && flLast == 40.f);
+}
+
+static void TestPartialPacket()
+{
+	std::vector<char> vecStream = MakePoseStream(3);
+	CPosePacketReader reader;
+	CPoseState poseState;
+
+	// half a packet publishes nothing
+	TEST_CHECK(ReceivePoseStream(&reader, &poseState, &vecStream[0], 8) == 0);
+	TEST_CHECK(poseState.Read().quat[0] == 0.f && poseState.Read().quat[3] == 1.f);
+
+	// Reset() drops it, as after a reconnect: the next connection starts on a packet boundary
+	reader.Reset();
+	TEST_CHECK(ReceivePoseStream(&reader, &poseState, &vecStream[16], 32) == 2);
+	TEST_CHECK(poseState.Read().quat[0] == 3.f);
+	TEST_CHECK(poseState.Read().ulTimestampUs == 0);
+}
+
+void TestPosePacket()
+{
+	TestPoseFraming();
+	TestPartialPacket();
+}
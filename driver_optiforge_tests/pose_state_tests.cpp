@@ -0,0 +1,60 @@
+#include "tests.h"
+#include "../driver_optiforge/pose_state.h"
+
+// --------------------------------------------------------------------------
+// BuildHmdPose: the sample age handed to the runtime for prediction
+// --------------------------------------------------------------------------
+static void TestSampleAge()
+{
+	PoseSample_t sample = { { 0.f, 0.f, 0.f, 1.f }, { 0.f, 1.7f, 0.f }, 5000000 };
+
+	// 20 ms old
+	TEST_CHECK_NEAR(BuildHmdPose(sample, true, 5020000).poseTimeOffset, -0.02, 1e-9);
+	TEST_CHECK(BuildHmdPose(sample, true, 5000000).poseTimeOffset == 0.0);
+
+	// stamped after "now", by a producer clock slightly ahead: brand new, not hours old
+	TEST_CHECK(BuildHmdPose(sample, true, 4999000).poseTimeOffset == 0.0);
+	TEST_CHECK(BuildHmdPose(sample, true, 1).poseTimeOffset == 0.0);
+
+	// no timestamp from the transport
+	sample.ulTimestampUs = 0;
+	TEST_CHECK(BuildHmdPose(sample, true, 5020000).poseTimeOffset == 0.0);
+
+	TEST_CHECK(BuildHmdPose(sample, true, 0).result == vr::TrackingResult_Running_OK);
+	TEST_CHECK(BuildHmdPose(sample, false, 0).result == vr::TrackingResult_Running_OutOfRange);
+}
+
+// --------------------------------------------------------------------------
+// The position travels with its orientation through the history, so a hand
+// frame matched to an earlier head pose gets the head's position of then
+// --------------------------------------------------------------------------
+static void TestSamplePosition()
+{
+	CPoseState poseState;
+	TEST_CHECK(poseState.Read().position[1] == k_flDefaultHeadPosition[1]);
+
+	const float quat[4] = { 0.f, 0.f, 0.f, 1.f };
+	const float before[3] = { 0.1f, 1.6f, -0.2f };
+	const float after[3] = { 0.5f, 1.2f, 0.3f };
+	poseState.Update(quat, before, 0);
+	uint64_t ulBetweenUs = CPoseState::ArrivalNowUs();
+	while (CPoseState::ArrivalNowUs() == ulBetweenUs)
+	{
+	}
+	poseState.Update(quat, after, 0);
+
+	PoseSample_t earlier = poseState.ReadArrivedBy(ulBetweenUs);
+	TEST_CHECK(earlier.position[0] == before[0] && earlier.position[1] == before[1] && earlier.position[2] == before[2]);
+	vr::DriverPose_t pose = BuildHmdPose(poseState.Read(), true, 0);
+	TEST_CHECK(pose.vecPosition[0] == after[0] && pose.vecPosition[1] == after[1] && pose.vecPosition[2] == after[2]);
+
+	// orientation-only transports leave the head where it stands by default
+	poseState.Update(quat, 0);
+	TEST_CHECK(poseState.Read().position[1] == k_flDefaultHeadPosition[1]);
+}
+
+void TestPoseState()
+{
+	TestSampleAge();
+	TestSamplePosition();
+}
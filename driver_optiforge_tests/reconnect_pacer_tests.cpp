@@ -0,0 +1,60 @@
+#include "tests.h"
+#include "../driver_optiforge/reconnect_pacer.h"
+
+using std::chrono::milliseconds;
+
+// --------------------------------------------------------------------------
+// CReconnectPacer: how often a receive loop connects for a few kinds of
+// misbehaving sender, counted over a simulated minute
+// --------------------------------------------------------------------------
+enum ESender
+{
+	Sender_Unreachable,		// every connect fails
+	Sender_AcceptAndDrop,	// accepts and closes straight away
+	Sender_Flaky,			// keeps each connection up for 5 s
+};
+
+static int ConnectsPerMinute(ESender eSender)
+{
+	CReconnectPacer pacer;
+	CReconnectPacer::Clock::time_point now = CReconnectPacer::Clock::time_point() + std::chrono::hours(1);
+	CReconnectPacer::Clock::time_point end = now + std::chrono::minutes(1);
+
+	int nConnects = 0;
+	while (now < end)
+	{
+		nConnects++;
+		now += milliseconds(1);		// the connect itself
+		if (eSender == Sender_Unreachable)
+		{
+			now += pacer.DelayAfterConnectFailure();
+			continue;
+		}
+
+		pacer.Connected(now);
+		now += eSender == Sender_Flaky ? milliseconds(5000) : milliseconds(2);
+		now += pacer.DelayAfterConnectionLost(now);
+	}
+	return nConnects;
+}
+
+static void TestReconnectPacing()
+{
+	// neither an unreachable sender nor one that drops us at once makes the loop spin
+	TEST_CHECK(ConnectsPerMinute(Sender_Unreachable) <= 60);
+	TEST_CHECK(ConnectsPerMinute(Sender_AcceptAndDrop) <= 60);
+
+	// a connection that was up for a while is reopened without waiting
+	TEST_CHECK(ConnectsPerMinute(Sender_Flaky) == 12);
+
+	CReconnectPacer pacer;
+	CReconnectPacer::Clock::time_point connectedAt = CReconnectPacer::Clock::time_point() + std::chrono::hours(1);
+	pacer.Connected(connectedAt);
+	TEST_CHECK(pacer.DelayAfterConnectionLost(connectedAt + k_minConnectionLifetime - milliseconds(1)) == k_reconnectDelay);
+	TEST_CHECK(pacer.DelayAfterConnectionLost(connectedAt + k_minConnectionLifetime) == milliseconds(0));
+}
+
+void TestReconnectPacer()
+{
+	TestReconnectPacing();
+}
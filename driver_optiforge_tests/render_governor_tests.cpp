@@ -0,0 +1,405 @@
+#include "tests.h"
+#include "../driver_optiforge/render_governor.h"
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+// --------------------------------------------------------------------------
+// Replay: runs a trace through the governor in closed loop. A trace holds the
+// application's GPU time at the scale each frame was rendered at; once the
+// governor recommends another scale, RescaleFrameTimingSample() gives the
+// time at that scale, so the trace behaves like the application would have.
+// --------------------------------------------------------------------------
+struct ReplayResult_t
+{
+	std::vector<float> vecScales;	// recommended scale after each frame
+	uint32_t unChanges = 0;
+	uint32_t unReversals = 0;		// changes that undo the previous one before the oscillation window is over
+	float flLowestScale = 0.f;
+	float flHighestScale = 0.f;
+};
+
+// A change in the opposite direction within this many settle periods counts as oscillation
+static const uint32_t k_unOscillationSettlePeriods = 3;
+
+// flStartScale is the scale a previous session ended at, 0 to start from the maximum
+static ReplayResult_t ReplayTrace(const std::vector<FrameTimingTraceEntry_t>& vecTrace, const RenderGovernorSettings_t& settings, float flDisplayFrequency, bool bPrintChanges,
+	float flStartScale = 0.f)
+{
+	CRenderGovernor governor;
+	governor.Configure(settings, flDisplayFrequency);
+	if (flStartScale > 0.f)
+		governor.ResumeAt(flStartScale);
+
+	ReplayResult_t result;
+	result.flLowestScale = result.flHighestScale = governor.GetScale();
+	int nLastDirection = 0;
+	size_t nLastChange = 0;
+
+	for (size_t i = 0; i < vecTrace.size(); i++)
+	{
+		const FrameTimingTraceEntry_t& entry = vecTrace[i];
+		float flScale = governor.GetScale();
+		FrameTimingSample_t sample = RescaleFrameTimingSample(entry.sample, entry.flScale, flScale, flDisplayFrequency);
+
+		if (governor.AddSample(sample))
+		{
+			int nDirection = governor.GetScale() > flScale ? 1 : -1;
+			if (nLastDirection != 0 && nDirection != nLastDirection && i - nLastChange < k_unOscillationSettlePeriods * settings.unSettleFrames)
+				result.unReversals++;
+			nLastDirection = nDirection;
+			nLastChange = i;
+			result.unChanges++;
+
+			if (bPrintChanges)
+			{
+				printf("frame %u: scale %.2f -> %.2f (app gpu %.2f ms, compositor gpu %.2f ms, cpu %.2f ms)\n", sample.unFrameIndex,
+					flScale, governor.GetScale(), governor.GetSmoothedGpuMs(), governor.GetSmoothedCompositorGpuMs(), governor.GetSmoothedCpuMs());
+			}
+		}
+
+		result.vecScales.push_back(governor.GetScale());
+		result.flLowestScale = std::min(result.flLowestScale, governor.GetScale());
+		result.flHighestScale = std::max(result.flHighestScale, governor.GetScale());
+	}
+	return result;
+}
+
+struct SyntheticApp_t
+{
+	std::function<float(uint32_t unFrame)> appGpuMs;	// at scale 1
+	std::function<float(uint32_t unFrame)> cpuMs = [](uint32_t) { return 4.f; };
+	float flCompositorGpuMs = 1.5f;
+	float flNoise = 0.05f;								// uniform, relative
+};
+
+// A trace as the driver records it in a session rendered at flRenderedScale (1 with adaptive
+// resolution off), with every frame whose GPU time doesn't fit the budget reported as missed
+static std::vector<FrameTimingTraceEntry_t> MakeTrace(const SyntheticApp_t& app, uint32_t unFrames, float flDisplayFrequency, uint32_t unSeed, float flRenderedScale = 1.f)
+{
+	std::mt19937 rng(unSeed);
+	std::uniform_real_distribution<float> noise(1.f - app.flNoise, 1.f + app.flNoise);
+	float flBudgetMs = 1000.f / flDisplayFrequency;
+
+	std::vector<FrameTimingTraceEntry_t> vecTrace(unFrames);
+	for (uint32_t i = 0; i < unFrames; i++)
+	{
+		FrameTimingTraceEntry_t& entry = vecTrace[i];
+		entry.flScale = flRenderedScale;
+		entry.sample.unFrameIndex = i + 1;
+		entry.sample.flGpuMs = app.appGpuMs(i) * flRenderedScale * flRenderedScale * noise(rng);
+		entry.sample.flCompositorGpuMs = app.flCompositorGpuMs * noise(rng);
+		entry.sample.flCpuMs = app.cpuMs(i) * noise(rng);
+		entry.sample.unMissedFrames = entry.sample.flGpuMs + entry.sample.flCompositorGpuMs > flBudgetMs ? 1 : 0;
+	}
+	return vecTrace;
+}
+
+static std::function<float(uint32_t)> Constant(float flValue)
+{
+	return [flValue](uint32_t) { return flValue; };
+}
+
+static void CheckWithinRange(const ReplayResult_t& result, const RenderGovernorSettings_t& settings)
+{
+	TEST_CHECK(result.flLowestScale >= settings.flMinScale - 1e-6f);
+	TEST_CHECK(result.flHighestScale <= settings.flMaxScale + 1e-6f);
+}
+
+// --------------------------------------------------------------------------
+// The range limits are exact, including a maximum that isn't a whole number
+// of steps above the minimum
+// --------------------------------------------------------------------------
+static void TestClamping()
+{
+	const float flHz = 90.f;
+
+	RenderGovernorSettings_t settings;
+	settings.flMinScale = 0.63f;
+	settings.flMaxScale = 1.0f;
+
+	CRenderGovernor governor;
+	governor.Configure(settings, flHz);
+	TEST_CHECK(governor.GetScale() == settings.flMaxScale);
+
+	// far too heavy for any scale: it goes all the way down and stops there
+	SyntheticApp_t heavy;
+	heavy.appGpuMs = Constant(40.f);
+	ReplayResult_t result = ReplayTrace(MakeTrace(heavy, 60 * 90, flHz, 1), settings, flHz, false);
+	CheckWithinRange(result, settings);
+	TEST_CHECK(result.vecScales.back() == settings.flMinScale);
+
+	// trivially light after being pushed down: back up to exactly the maximum
+	SyntheticApp_t heavyThenLight;
+	heavyThenLight.appGpuMs = [](uint32_t unFrame) { return unFrame < 20 * 90 ? 40.f : 2.f; };
+	result = ReplayTrace(MakeTrace(heavyThenLight, 60 * 90, flHz, 2), settings, flHz, false);
+	CheckWithinRange(result, settings);
+	TEST_CHECK(result.flLowestScale == settings.flMinScale);
+	TEST_CHECK(result.vecScales.back() == settings.flMaxScale);
+
+	// supersampling range
+	settings.flMinScale = 0.8f;
+	settings.flMaxScale = 1.37f;
+	result = ReplayTrace(MakeTrace(heavyThenLight, 60 * 90, flHz, 3), settings, flHz, false);
+	CheckWithinRange(result, settings);
+	TEST_CHECK(result.vecScales.back() == settings.flMaxScale);
+}
+
+// --------------------------------------------------------------------------
+// Hysteresis: for any steady load, with noise, the scale settles without
+// ever undoing a change, and where it settles the load is inside the band
+// --------------------------------------------------------------------------
+static void TestSteadyLoadDoesNotOscillate()
+{
+	const float flHz = 90.f;
+	const uint32_t k_unFrames = 60 * 90;
+	RenderGovernorSettings_t settings;
+	float flBudgetMs = 1000.f / flHz;
+
+	for (float flAppGpuMs = 3.f; flAppGpuMs <= 30.f; flAppGpuMs += 0.5f)
+	{
+		SyntheticApp_t app;
+		app.appGpuMs = Constant(flAppGpuMs);
+		ReplayResult_t result = ReplayTrace(MakeTrace(app, k_unFrames, flHz, (uint32_t)(flAppGpuMs * 10)), settings, flHz, false);
+		CheckWithinRange(result, settings);
+
+		if (result.unReversals != 0)
+			fprintf(stderr, "app gpu %.1f ms: %u reversals\n", flAppGpuMs, result.unReversals);
+		TEST_CHECK(result.unReversals == 0);
+
+		// settled in the first half; a load right at a threshold may still cross it once later on
+		uint32_t unLateChanges = 0;
+		for (size_t i = k_unFrames / 2; i < k_unFrames; i++)
+			unLateChanges += result.vecScales[i] != result.vecScales[i - 1] ? 1 : 0;
+		TEST_CHECK(unLateChanges <= 1);
+		float flFinal = result.vecScales.back();
+
+		// and the load there gives no reason to move further, with some room for the noise
+		float flLoad = (flAppGpuMs * flFinal * flFinal + app.flCompositorGpuMs) / flBudgetMs;
+		if (flFinal > settings.flMinScale)
+			TEST_CHECK(flLoad <= settings.flLowerAboveLoad + 0.05f);
+		if (flFinal < settings.flMaxScale)
+			TEST_CHECK(flLoad >= settings.flRaiseBelowLoad - 0.05f);
+	}
+}
+
+// --------------------------------------------------------------------------
+// Recovery: a heavy scene lowers the scale quickly, and once it is over the
+// full scale comes back within a few seconds
+// --------------------------------------------------------------------------
+static void TestRecovery()
+{
+	const float flHz = 90.f;
+	const uint32_t k_unHeavyEnd = 30 * 90;
+	RenderGovernorSettings_t settings;
+
+	SyntheticApp_t app;
+	app.appGpuMs = [](uint32_t unFrame) { return unFrame >= 5 * 90 && unFrame < k_unHeavyEnd ? 16.f : 5.f; };
+	ReplayResult_t result = ReplayTrace(MakeTrace(app, 60 * 90, flHz, 4), settings, flHz, false);
+	CheckWithinRange(result, settings);
+	TEST_CHECK(result.unReversals == 0);
+
+	// full scale while light, below it a second into the heavy part
+	TEST_CHECK(result.vecScales[5 * 90 - 1] == settings.flMaxScale);
+	TEST_CHECK(result.vecScales[6 * 90] < settings.flMaxScale);
+
+	// the heavy part needs about sqrt(0.8 * 11.1 - 1.5) / 16) = 0.68
+	TEST_CHECK_NEAR(result.vecScales[k_unHeavyEnd - 1], 0.68, 0.05);
+
+	uint32_t unRecovered = k_unHeavyEnd;
+	while (unRecovered < result.vecScales.size() && result.vecScales[unRecovered] != settings.flMaxScale)
+		unRecovered++;
+	TEST_CHECK(unRecovered - k_unHeavyEnd <= 5 * 90);
+	TEST_CHECK(result.vecScales.back() == settings.flMaxScale);
+}
+
+// --------------------------------------------------------------------------
+// Missed frames step down right away, but no faster than the hold allows,
+// and the scale only grows back once there have been no misses for a while.
+// A CPU bound application isn't given a larger target it can't use.
+// --------------------------------------------------------------------------
+static void TestMissedFramesAndCpuBound()
+{
+	const float flHz = 90.f;
+	RenderGovernorSettings_t settings;
+
+	// A load inside the band at full scale, so only the misses move the scale. Two steps
+	// down it is below the raise threshold, but it must not grow right back.
+	SyntheticApp_t app;
+	app.appGpuMs = Constant(7.f);
+	app.flNoise = 0.f;
+	std::vector<FrameTimingTraceEntry_t> vecTrace = MakeTrace(app, 30 * 90, flHz, 5);
+	const uint32_t k_unFirstMiss = 5 * 90;
+	const uint32_t k_unLastMiss = k_unFirstMiss + 30 + settings.unHoldAfterMissFrames;
+	for (uint32_t i = 0; i < 30; i++)
+		vecTrace[k_unFirstMiss + i].sample.unMissedFrames = 1;
+	vecTrace[k_unLastMiss].sample.unMissedFrames = 1;
+
+	ReplayResult_t result = ReplayTrace(vecTrace, settings, flHz, false);
+	TEST_CHECK(result.vecScales[k_unFirstMiss - 1] == settings.flMaxScale);
+	TEST_CHECK_NEAR(result.vecScales[k_unFirstMiss], settings.flMaxScale - settings.flStep, 1e-5);
+	TEST_CHECK_NEAR(result.vecScales[k_unFirstMiss + 29], settings.flMaxScale - settings.flStep, 1e-5);
+	TEST_CHECK_NEAR(result.vecScales[k_unLastMiss], settings.flMaxScale - 2 * settings.flStep, 1e-5);
+	TEST_CHECK_NEAR(result.vecScales[k_unLastMiss + settings.unNoRaiseAfterMissFrames - 1], settings.flMaxScale - 2 * settings.flStep, 1e-5);
+	TEST_CHECK(result.vecScales.back() == settings.flMaxScale);
+	TEST_CHECK(result.unChanges == 3);
+	TEST_CHECK(result.unReversals == 0);
+
+	// GPU heavy first, then light on the GPU but CPU bound: the scale has to stay down
+	SyntheticApp_t cpuBound;
+	cpuBound.appGpuMs = [](uint32_t unFrame) { return unFrame < 10 * 90 ? 16.f : 3.f; };
+	cpuBound.cpuMs = [](uint32_t unFrame) { return unFrame < 10 * 90 ? 4.f : 10.5f; };
+	result = ReplayTrace(MakeTrace(cpuBound, 40 * 90, flHz, 6), settings, flHz, false);
+	TEST_CHECK(result.vecScales.back() == result.vecScales[10 * 90 + settings.unSettleFrames]);
+	TEST_CHECK(result.vecScales.back() < settings.flMaxScale);
+}
+
+// --------------------------------------------------------------------------
+// Configuring again with the settings in use, as the driver does after any
+// settings edit, keeps the scale and the smoothed timings; new settings or a
+// new display frequency start over at the maximum
+// --------------------------------------------------------------------------
+static void TestReconfigure()
+{
+	const float flHz = 90.f;
+	RenderGovernorSettings_t settings;
+
+	CRenderGovernor governor;
+	governor.Configure(settings, flHz);
+	FrameTimingSample_t sample = { 0, 16.f, 1.5f, 4.f, 0 };
+	for (uint32_t i = 1; i <= 5 * 90; i++)
+	{
+		sample.unFrameIndex = i;
+		governor.AddSample(sample);
+	}
+	float flScale = governor.GetScale();
+	float flGpuMs = governor.GetSmoothedGpuMs();
+	TEST_CHECK(flScale < settings.flMaxScale);
+
+	governor.Configure(settings, flHz);
+	TEST_CHECK(governor.GetScale() == flScale);
+	TEST_CHECK(governor.GetSmoothedGpuMs() == flGpuMs);
+
+	governor.Configure(settings, 120.f);
+	TEST_CHECK(governor.GetScale() == settings.flMaxScale);
+
+	governor.AddSample(sample);
+	settings.flMinScale = 0.5f;
+	governor.Configure(settings, 120.f);
+	TEST_CHECK(governor.GetScale() == settings.flMaxScale);
+	TEST_CHECK(governor.GetSmoothedGpuMs() == 0.f);
+}
+
+// --------------------------------------------------------------------------
+// Sessions: SteamVR takes the recommended size when the headset is activated,
+// so a session renders at the scale it started with and the governor works on
+// rescaled timings. The scale it ends at starts the next session, which on the
+// same load keeps it; a saved scale outside a new range is clamped to it.
+// --------------------------------------------------------------------------
+static void TestAcrossSessions()
+{
+	const float flHz = 90.f;
+	RenderGovernorSettings_t settings;
+
+	SyntheticApp_t app;
+	app.appGpuMs = Constant(16.f);
+	ReplayResult_t first = ReplayTrace(MakeTrace(app, 30 * 90, flHz, 7), settings, flHz, false);
+	float flLearned = first.vecScales.back();
+	TEST_CHECK(flLearned < settings.flMaxScale);
+	TEST_CHECK(first.unReversals == 0);
+
+	ReplayResult_t second = ReplayTrace(MakeTrace(app, 30 * 90, flHz, 8, flLearned), settings, flHz, false, flLearned);
+	TEST_CHECK(second.vecScales.front() == flLearned);
+	TEST_CHECK(second.unChanges == 0);
+
+	// a lighter scene next time grows back from there
+	SyntheticApp_t light;
+	light.appGpuMs = Constant(5.f);
+	ReplayResult_t third = ReplayTrace(MakeTrace(light, 30 * 90, flHz, 9, flLearned), settings, flHz, false, flLearned);
+	TEST_CHECK(third.vecScales.back() == settings.flMaxScale);
+	TEST_CHECK(third.unReversals == 0);
+
+	CRenderGovernor governor;
+	governor.Configure(settings, flHz);
+	governor.ResumeAt(1.5f);
+	TEST_CHECK(governor.GetScale() == settings.flMaxScale);
+	governor.ResumeAt(0.3f);
+	TEST_CHECK(governor.GetScale() == settings.flMinScale);
+}
+
+// --------------------------------------------------------------------------
+// The trace format reads back what the writer wrote
+// --------------------------------------------------------------------------
+static void TestTraceRoundTrip()
+{
+	const char* pchPath = "render_governor_test_trace.csv";
+
+	std::vector<FrameTimingTraceEntry_t> vecWritten;
+	{
+		CFrameTimingTraceWriter writer;
+		TEST_CHECK(writer.Open(pchPath));
+		for (uint32_t i = 0; i < 100; i++)
+		{
+			FrameTimingTraceEntry_t entry;
+			entry.flScale = 0.6f + i * 0.004f;
+			entry.sample.unFrameIndex = 1000 + i;
+			entry.sample.flGpuMs = 5.f + i * 0.125f;
+			entry.sample.flCompositorGpuMs = 1.25f;
+			entry.sample.flCpuMs = 3.5f;
+			entry.sample.unMissedFrames = i % 7 == 0 ? 2 : 0;
+			writer.Write(entry.flScale, entry.sample);
+			vecWritten.push_back(entry);
+		}
+	}
+
+	std::vector<FrameTimingTraceEntry_t> vecRead;
+	TEST_CHECK(ReadFrameTimingTrace(pchPath, &vecRead));
+	remove(pchPath);
+
+	TEST_CHECK(vecRead.size() == vecWritten.size());
+	for (size_t i = 0; i < std::min(vecRead.size(), vecWritten.size()); i++)
+	{
+		TEST_CHECK(vecRead[i].sample.unFrameIndex == vecWritten[i].sample.unFrameIndex);
+		TEST_CHECK_NEAR(vecRead[i].flScale, vecWritten[i].flScale, 1e-3);
+		TEST_CHECK_NEAR(vecRead[i].sample.flGpuMs, vecWritten[i].sample.flGpuMs, 1e-3);
+		TEST_CHECK_NEAR(vecRead[i].sample.flCompositorGpuMs, vecWritten[i].sample.flCompositorGpuMs, 1e-3);
+		TEST_CHECK_NEAR(vecRead[i].sample.flCpuMs, vecWritten[i].sample.flCpuMs, 1e-3);
+		TEST_CHECK(vecRead[i].sample.unMissedFrames == vecWritten[i].sample.unMissedFrames);
+	}
+}
+
+void TestRenderGovernor()
+{
+	TestClamping();
+	TestSteadyLoadDoesNotOscillate();
+	TestRecovery();
+	TestMissedFramesAndCpuBound();
+	TestReconfigure();
+	TestAcrossSessions();
+	TestTraceRoundTrip();
+}
+
+int ReplayFrameTimingTraceFile(const char* pchPath, float flMinScale, float flMaxScale, float flDisplayFrequency)
+{
+	std::vector<FrameTimingTraceEntry_t> vecTrace;
+	if (!ReadFrameTimingTrace(pchPath, &vecTrace) || vecTrace.empty())
+	{
+		fprintf(stderr, "Unable to read a frame timing trace from %s\n", pchPath);
+		return 2;
+	}
+
+	RenderGovernorSettings_t settings;
+	settings.flMinScale = flMinScale;
+	settings.flMaxScale = flMaxScale;
+	ReplayResult_t result = ReplayTrace(vecTrace, settings, flDisplayFrequency, true);
+
+	printf("%u frames, %u changes, %u reversals, scale %.2f to %.2f\n", (uint32_t)vecTrace.size(), result.unChanges, result.unReversals,
+		result.flLowestScale, result.flHighestScale);
+
+	CheckWithinRange(result, settings);
+	TEST_CHECK(result.unReversals == 0);
+	return g_nFailedChecks == 0 ? 0 : 1;
+}
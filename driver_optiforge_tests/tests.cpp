@@ -0,0 +1,67 @@
+// Unit tests for the driver's pure, platform independent parts.
+//
+//   driver_optiforge_tests [--filter <name>]
+//   driver_optiforge_tests --replay <trace.csv> [--min <scale>] [--max <scale>] [--hz <display frequency>]
+//
+// Without --replay every test whose name contains the filter runs, and the exit
+// code is 1 if any check failed. --replay runs a frame timing trace recorded by
+// the driver (the renderGovernorTrace setting) through CRenderGovernor, prints
+// every scale change and exits with 1 if the run breaks the governor's
+// invariants; see render_governor_tests.cpp.
+
+#include "tests.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+int g_nFailedChecks = 0;
+
+int main(int argc, char** argv)
+{
+	const char* pchFilter = NULL;
+	const char* pchReplayPath = NULL;
+	float flMinScale = 0.6f;
+	float flMaxScale = 1.0f;
+	float flDisplayFrequency = 90.f;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string sArg = argv[i];
+		if (sArg == "--filter")
+			pchFilter = argv[i + 1];
+		else if (sArg == "--replay")
+			pchReplayPath = argv[i + 1];
+		else if (sArg == "--min")
+			flMinScale = (float)atof(argv[i + 1]);
+		else if (sArg == "--max")
+			flMaxScale = (float)atof(argv[i + 1]);
+		else if (sArg == "--hz")
+			flDisplayFrequency = (float)atof(argv[i + 1]);
+	}
+
+	if (pchReplayPath)
+		return ReplayFrameTimingTraceFile(pchReplayPath, flMinScale, flMaxScale, flDisplayFrequency);
+
+	struct Test_t { const char* pchName; void(*pFunc)(); };
+	const Test_t tests[] = {
+		{ "render_governor", TestRenderGovernor },
+		{ "pose_math", TestPoseMath },
+		{ "hand_packet", TestHandPacket },
+		{ "pose_state", TestPoseState },
+		{ "pose_packet", TestPosePacket },
+		{ "reconnect_pacer", TestReconnectPacer },
+	};
+
+	for (const Test_t& test : tests)
+	{
+		if (pchFilter && !strstr(test.pchName, pchFilter))
+			continue;
+
+		int nFailedBefore = g_nFailedChecks;
+		test.pFunc();
+		printf("%-20s %s\n", test.pchName, g_nFailedChecks == nFailedBefore ? "ok" : "FAILED");
+	}
+
+	return g_nFailedChecks == 0 ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+
+// Failed checks so far; main() exits with 1 when it isn't 0
+extern int g_nFailedChecks;
+
+#define TEST_CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			g_nFailedChecks++; \
+		} \
+	} while (0)
+
+#define TEST_CHECK_NEAR(actual, expected, tolerance) \
+	do { \
+		double flActual_ = (actual), flExpected_ = (expected); \
+		if (!(fabs(flActual_ - flExpected_) <= (tolerance))) { \
+			fprintf(stderr, "%s:%d: %s is %g, expected %g within %g\n", __FILE__, __LINE__, #actual, flActual_, flExpected_, (double)(tolerance)); \
+			g_nFailedChecks++; \
+		} \
+	} while (0)
+
+// render_governor_tests.cpp
+extern void TestRenderGovernor();
+extern int ReplayFrameTimingTraceFile(const char* pchPath, float flMinScale, float flMaxScale, float flDisplayFrequency);
+
+// pose_math_tests.cpp
+extern void TestPoseMath();
+
+// hand_packet_tests.cpp
+extern void TestHandPacket();
+
+// pose_state_tests.cpp
+extern void TestPoseState();
+
+// pose_packet_tests.cpp
+extern void TestPosePacket();
+
+// reconnect_pacer_tests.cpp
+extern void TestReconnectPacer();
+
+#endif // TESTS_H
@@ -0,0 +1,353 @@
+#ifndef IMPAIRMENT_H
+#define IMPAIRMENT_H
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <math.h>
+#include <random>
+#include <sstream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// --------------------------------------------------------------------------
+// One stretch of a profile. A reset phase has no duration, it tears down
+// every connection at the moment the profile reaches it.
+// --------------------------------------------------------------------------
+struct ImpairmentPhase_t
+{
+	std::string sName;
+	double flDurationMs = 0.0;
+	bool bReset = false;
+
+	double flDelayMs = 0.0;			// one way, added to every packet
+	double flJitterMs = 0.0;		// uniform extra delay in [0, jitter]
+	double flLossPercent = 0.0;		// chance that a loss burst starts at a packet
+	double flBurst = 1.0;			// mean packets per loss burst
+	double flReorderPercent = 0.0;	// chance that a packet is held back by flReorderMs
+	double flReorderMs = 20.0;
+	double flRtoMs = 200.0;			// TCP: a lost segment arrives this much later, everything behind it waits
+	double flRateKbps = 0.0;		// 0 is unlimited
+	bool bOutage = false;			// nothing gets through: TCP data waits, datagrams are dropped
+	bool bRefuse = false;			// TCP: new connections are reset right after accept
+};
+
+// Parses "250ms", "30s", "5m" or "2h" into milliseconds
+inline bool ParseDuration(const std::string& sText, double* pflMs)
+{
+	char* pchEnd = nullptr;
+	double flValue = strtod(sText.c_str(), &pchEnd);
+	std::string sUnit = pchEnd ? pchEnd : "";
+	if (pchEnd == sText.c_str() || flValue < 0.0)
+		return false;
+
+	if (sUnit == "ms")
+		*pflMs = flValue;
+	else if (sUnit == "s")
+		*pflMs = flValue * 1000.0;
+	else if (sUnit == "m")
+		*pflMs = flValue * 60000.0;
+	else if (sUnit == "h")
+		*pflMs = flValue * 3600000.0;
+	else
+		return false;
+	return true;
+}
+
+// --------------------------------------------------------------------------
+// Purpose: A scripted sequence of phases, read from a profile file:
+//
+//              # comment
+//              <duration> [name=<label>] key=value ...
+//              reset
+//
+//          Keys are delay, jitter, rto and reorder_delay in ms, loss and
+//          reorder in percent, burst in packets, rate in kbit/s and outage
+//          and refuse as 0/1. Missing keys keep the ImpairmentPhase_t
+//          defaults: 0 for everything except rto 200, reorder_delay 20 and
+//          burst 1, which only matter once loss or reorder is set, so a
+//          phase without keys is a clean link. The profile starts over when
+//          it reaches the end.
+// --------------------------------------------------------------------------
+class CImpairmentProfile
+{
+public:
+	bool Load(const std::string& sPath, std::string* psError)
+	{
+		std::ifstream file(sPath);
+		if (!file)
+		{
+			*psError = "can't open " + sPath;
+			return false;
+		}
+
+		m_vecPhases.clear();
+		std::string sLine;
+		for (int nLine = 1; std::getline(file, sLine); nLine++)
+		{
+			std::string::size_type nComment = sLine.find('#');
+			if (nComment != std::string::npos)
+				sLine.erase(nComment);
+
+			std::istringstream tokens(sLine);
+			std::string sFirst;
+			if (!(tokens >> sFirst))
+				continue;
+
+			ImpairmentPhase_t phase;
+			if (sFirst == "reset")
+			{
+				phase.sName = "reset";
+				phase.bReset = true;
+			}
+			else if (!ParseDuration(sFirst, &phase.flDurationMs) || phase.flDurationMs <= 0.0)
+			{
+				*psError = sPath + ":" + std::to_string(nLine) + ": expected a duration like 30s or 'reset', got '" + sFirst + "'";
+				return false;
+			}
+			else
+			{
+				phase.sName = "phase " + std::to_string(m_vecPhases.size() + 1);
+				std::string sSettings;
+				std::getline(tokens, sSettings);
+				std::string sError;
+				if (!ParseSettings(sSettings, &phase, &sError))
+				{
+					*psError = sPath + ":" + std::to_string(nLine) + ": " + sError;
+					return false;
+				}
+			}
+			m_vecPhases.push_back(phase);
+		}
+
+		return Validate(sPath, psError);
+	}
+
+	// A single endless phase from "key=value ..."
+	bool FromSettings(const std::string& sSettings, std::string* psError)
+	{
+		ImpairmentPhase_t phase;
+		phase.sName = "impair";
+		phase.flDurationMs = HUGE_VAL;
+		if (!ParseSettings(sSettings, &phase, psError))
+			return false;
+		m_vecPhases.assign(1, phase);
+		return true;
+	}
+
+	const std::vector<ImpairmentPhase_t>& Phases() const { return m_vecPhases; }
+
+private:
+	static bool ParseSettings(const std::string& sSettings, ImpairmentPhase_t* pPhase, std::string* psError)
+	{
+		std::istringstream tokens(sSettings);
+		std::string sToken;
+		while (tokens >> sToken)
+		{
+			std::string::size_type nEquals = sToken.find('=');
+			if (nEquals == std::string::npos)
+			{
+				*psError = "expected key=value, got '" + sToken + "'";
+				return false;
+			}
+			std::string sKey = sToken.substr(0, nEquals);
+			std::string sValue = sToken.substr(nEquals + 1);
+			if (sKey == "name")
+			{
+				pPhase->sName = sValue;
+				continue;
+			}
+
+			char* pchEnd = nullptr;
+			double flValue = strtod(sValue.c_str(), &pchEnd);
+			if (sValue.empty() || *pchEnd != '\0' || flValue < 0.0)
+			{
+				*psError = "'" + sKey + "' needs a non-negative number, got '" + sValue + "'";
+				return false;
+			}
+
+			if (sKey == "delay")
+				pPhase->flDelayMs = flValue;
+			else if (sKey == "jitter")
+				pPhase->flJitterMs = flValue;
+			else if (sKey == "loss")
+				pPhase->flLossPercent = std::min(flValue, 100.0);
+			else if (sKey == "burst")
+				pPhase->flBurst = std::max(flValue, 1.0);
+			else if (sKey == "reorder")
+				pPhase->flReorderPercent = std::min(flValue, 100.0);
+			else if (sKey == "reorder_delay")
+				pPhase->flReorderMs = flValue;
+			else if (sKey == "rto")
+				pPhase->flRtoMs = flValue;
+			else if (sKey == "rate")
+				pPhase->flRateKbps = flValue;
+			else if (sKey == "outage")
+				pPhase->bOutage = flValue != 0.0;
+			else if (sKey == "refuse")
+				pPhase->bRefuse = flValue != 0.0;
+			else
+			{
+				*psError = "unknown key '" + sKey + "'";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool Validate(const std::string& sPath, std::string* psError) const
+	{
+		for (const ImpairmentPhase_t& phase : m_vecPhases)
+		{
+			if (!phase.bReset)
+				return true;
+		}
+		*psError = sPath + ": needs at least one timed phase";
+		return false;
+	}
+
+	std::vector<ImpairmentPhase_t> m_vecPhases;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: Walks a profile in real time, looping at the end
+// --------------------------------------------------------------------------
+class CImpairmentSchedule
+{
+public:
+	CImpairmentSchedule(const CImpairmentProfile& profile, Clock::time_point start)
+		: m_profile(profile), m_unPhase((uint32_t)profile.Phases().size() - 1), m_phaseEnd(start)
+	{
+		Advance(start);
+	}
+
+	// Moves to the phase covering now; returns how many resets were passed on the way
+	int Advance(Clock::time_point now)
+	{
+		const std::vector<ImpairmentPhase_t>& vecPhases = m_profile.Phases();
+		int nResets = 0;
+		while (now >= m_phaseEnd)
+		{
+			m_unPhase = (m_unPhase + 1) % vecPhases.size();
+
+			const ImpairmentPhase_t& phase = vecPhases[m_unPhase];
+			if (phase.bReset)
+			{
+				nResets++;
+				continue;
+			}
+
+			if (phase.flDurationMs == HUGE_VAL)
+				m_phaseEnd = Clock::time_point::max();
+			else
+				m_phaseEnd += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(phase.flDurationMs));
+		}
+		return nResets;
+	}
+
+	const ImpairmentPhase_t& Phase() const { return m_profile.Phases()[m_unPhase]; }
+	uint32_t PhaseIndex() const { return m_unPhase; }
+	Clock::time_point PhaseEnd() const { return m_phaseEnd; }
+
+private:
+	const CImpairmentProfile& m_profile;
+	uint32_t m_unPhase;
+	Clock::time_point m_phaseEnd;
+};
+
+struct PacketFate_t
+{
+	Clock::time_point deliverAt;
+	bool bDropped = false;		// datagrams only, a stream never loses data
+	bool bLost = false;			// lost on the wire: dropped, or retransmitted on a stream
+	bool bReordered = false;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: One direction of an impaired link. Decides when each packet that
+//          enters it comes out at the other end, if at all.
+// --------------------------------------------------------------------------
+class CLinkModel
+{
+public:
+	explicit CLinkModel(uint32_t unSeed) : m_rng(unSeed) {}
+
+	// bStream packets come out in order: a late one holds up everything behind it, the way
+	// TCP's in-order delivery turns loss and reordering into delay
+	PacketFate_t Schedule(const ImpairmentPhase_t& phase, Clock::time_point now, size_t nBytes, bool bStream)
+	{
+		PacketFate_t fate;
+		if (!bStream && phase.bOutage)
+		{
+			fate.bDropped = true;
+			return fate;
+		}
+
+		double flMs = phase.flDelayMs + Uniform() * phase.flJitterMs;
+
+		if (phase.flRateKbps > 0.0)
+		{
+			// kbit/s is bits per ms
+			Clock::time_point start = std::max(now, m_linkFreeAt);
+			m_linkFreeAt = start + ToDuration(nBytes * 8.0 / phase.flRateKbps);
+			double flQueuedMs = std::chrono::duration<double, std::milli>(m_linkFreeAt - now).count();
+			if (!bStream && flQueuedMs > k_flDatagramQueueMs)
+			{
+				fate.bDropped = true;
+				return fate;
+			}
+			flMs += flQueuedMs;
+		}
+
+		// Gilbert model: a burst starts with the loss chance and goes on with 1 - 1/burst
+		fate.bLost = m_bInLossBurst ? Uniform() < 1.0 - 1.0 / phase.flBurst : Uniform() * 100.0 < phase.flLossPercent;
+		m_bInLossBurst = fate.bLost;
+		if (fate.bLost)
+		{
+			if (!bStream)
+			{
+				fate.bDropped = true;
+				return fate;
+			}
+			flMs += phase.flRtoMs;
+		}
+
+		if (Uniform() * 100.0 < phase.flReorderPercent)
+		{
+			fate.bReordered = true;
+			flMs += phase.flReorderMs;
+		}
+
+		fate.deliverAt = now + ToDuration(flMs);
+		if (bStream)
+		{
+			fate.deliverAt = std::max(fate.deliverAt, m_lastDeliverAt);
+			m_lastDeliverAt = fate.deliverAt;
+		}
+		return fate;
+	}
+
+private:
+	// how much a rate-capped link buffers before it starts dropping datagrams
+	static constexpr double k_flDatagramQueueMs = 500.0;
+
+	static Clock::duration ToDuration(double flMs)
+	{
+		return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(flMs));
+	}
+
+	double Uniform() { return std::uniform_real_distribution<double>(0.0, 1.0)(m_rng); }
+
+	std::mt19937 m_rng;
+	bool m_bInLossBurst = false;
+	Clock::time_point m_linkFreeAt;
+	Clock::time_point m_lastDeliverAt;
+};
+
+#endif // IMPAIRMENT_H
@@ -0,0 +1,1323 @@
+// Network impairment proxy and soak test for the driver's receive path.
+//
+//   netproxy proxy --listen <[ip:]port> --target <ip:port> [--udp] [impairment] [--report <duration>]
+//   netproxy soak [--duration <duration>] [--rate <hz>] [--poll <hz>] [--stale <ms>] [--udp] [impairment]
+//                 [--report <duration>] [--csv <file>] [--max-recovery <ms>]
+//
+//   impairment: --profile <file> or --impair "<key=value ...>", and --seed <n>
+//
+// proxy sits between a sender and the driver: point the driver's ip and port at
+// --listen and it forwards to --target, impairing everything in between as the
+// profile says. soak runs a synthetic sender, the proxy and the driver's receive
+// path (recv -> ReceivePoseStream, reconnects paced by CReconnectPacer) in one
+// process and reports how old the pose the driver would hand out is, how many
+// samples never arrived and how long it takes to recover from every stall. It
+// exits with 1 when a stall took longer than --max-recovery.
+//
+// Linux only, built with the CMakeLists.txt next to this file.
+
+#include "impairment.h"
+#include "../../driver_optiforge/pose_packet.h"
+#include "../../driver_optiforge/pose_state.h"
+#include "../../driver_optiforge/reconnect_pacer.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static std::atomic<bool> g_bStop{ false };
+
+static void OnSignal(int)
+{
+	g_bStop = true;
+}
+
+static double MsSince(Clock::time_point start, Clock::time_point now)
+{
+	return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+static uint64_t NowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// Sleeps in short steps so a stop isn't held up
+static void SleepUnlessStopped(std::chrono::milliseconds duration)
+{
+	Clock::time_point end = Clock::now() + duration;
+	while (!g_bStop && Clock::now() < end)
+		std::this_thread::sleep_for(std::min(std::chrono::milliseconds(100), std::chrono::duration_cast<std::chrono::milliseconds>(end - Clock::now()) + std::chrono::milliseconds(1)));
+}
+
+// --------------------------------------------------------------------------
+// Sockets
+// --------------------------------------------------------------------------
+
+// "ip:port", or a bare port on 127.0.0.1
+static bool ParseAddress(const std::string& sText, sockaddr_in* pAddr)
+{
+	std::string sIP = "127.0.0.1";
+	std::string sPort = sText;
+	std::string::size_type nColon = sText.rfind(':');
+	if (nColon != std::string::npos)
+	{
+		sIP = sText.substr(0, nColon);
+		sPort = sText.substr(nColon + 1);
+	}
+
+	char* pchEnd = nullptr;
+	long nPort = strtol(sPort.c_str(), &pchEnd, 10);
+	memset(pAddr, 0, sizeof(*pAddr));
+	pAddr->sin_family = AF_INET;
+	pAddr->sin_port = htons((uint16_t)nPort);
+	return !sPort.empty() && *pchEnd == '\0' && nPort >= 0 && nPort <= 65535 && inet_pton(AF_INET, sIP.c_str(), &pAddr->sin_addr) == 1;
+}
+
+static void SetNonBlocking(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// What a dropped Wi-Fi association looks like to both ends once they notice
+static void CloseWithReset(int fd)
+{
+	linger lingerReset = { 1, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_LINGER, &lingerReset, sizeof(lingerReset));
+	close(fd);
+}
+
+static int OpenListener(const sockaddr_in& addr, bool bUdp)
+{
+	int fd = socket(AF_INET, bUdp ? SOCK_DGRAM : SOCK_STREAM, 0);
+	int nReuse = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &nReuse, sizeof(nReuse));
+	if (bind(fd, (const sockaddr*)&addr, sizeof(addr)) != 0 || (!bUdp && listen(fd, 8) != 0))
+	{
+		perror("netproxy: bind");
+		close(fd);
+		return -1;
+	}
+	SetNonBlocking(fd);
+	return fd;
+}
+
+static uint16_t BoundPort(int fd)
+{
+	sockaddr_in addr;
+	socklen_t nLength = sizeof(addr);
+	getsockname(fd, (sockaddr*)&addr, &nLength);
+	return ntohs(addr.sin_port);
+}
+
+// --------------------------------------------------------------------------
+// Purpose: Forwards TCP connections or UDP datagrams from the listen address
+//          to the target through a CLinkModel per direction. Runs on a
+//          single thread around poll().
+// --------------------------------------------------------------------------
+struct ProxyCounters_t
+{
+	uint64_t ulPackets = 0;		// segments or datagrams delivered
+	uint64_t ulBytes = 0;
+	uint64_t ulLost = 0;		// datagrams dropped, or TCP segments that had to be retransmitted
+	uint64_t ulReordered = 0;
+	uint64_t ulConnections = 0;
+	uint64_t ulRefused = 0;
+	uint64_t ulResets = 0;
+};
+
+class CImpairmentProxy
+{
+public:
+	CImpairmentProxy(const CImpairmentProfile& profile, const sockaddr_in& listenAddr, const sockaddr_in& targetAddr, bool bUdp, uint32_t unSeed)
+		: m_profile(profile), m_listenAddr(listenAddr), m_targetAddr(targetAddr), m_bUdp(bUdp), m_seeds(unSeed)
+	{
+	}
+
+	// Returns false if the listen address can't be bound
+	bool Run()
+	{
+		bool bResult = m_bUdp ? RunUdp() : RunTcp();
+		m_bStarted = true;
+		return bResult;
+	}
+
+	// The bound listen port once running, 0 before and after a failed start
+	uint16_t WaitForListenPort() const
+	{
+		while (!m_bStarted && !g_bStop)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return m_unListenPort;
+	}
+
+	ProxyCounters_t GetCounters()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_counters;
+	}
+
+	std::string PhaseName()
+	{
+		return m_profile.Phases()[m_unPhase].sName;
+	}
+
+private:
+	static const size_t k_nSegmentSize = 1448;
+	static const size_t k_nMaxQueuedBytes = 1 << 20;	// per direction; past this the source isn't read
+
+	struct Segment_t
+	{
+		Clock::time_point deliverAt;
+		std::vector<char> data;
+		size_t nSent;
+	};
+
+	struct Pipe_t
+	{
+		explicit Pipe_t(uint32_t unSeed) : model(unSeed) {}
+
+		CLinkModel model;
+		std::deque<Segment_t> queue;
+		size_t nQueuedBytes = 0;
+		bool bSourceClosed = false;
+		bool bBlocked = false;	// the destination's send buffer is full
+	};
+
+	struct Connection_t
+	{
+		Connection_t(uint32_t unSeedUp, uint32_t unSeedDown) : toUp(unSeedUp), toDown(unSeedDown) {}
+
+		int fdDown = -1;		// accepted from the listen socket
+		int fdUp = -1;			// connected to the target
+		bool bConnecting = true;
+		bool bDead = false;
+		Pipe_t toUp;
+		Pipe_t toDown;
+	};
+
+	int AdvanceSchedule(CImpairmentSchedule& schedule, Clock::time_point now)
+	{
+		int nResets = schedule.Advance(now);
+		m_unPhase = schedule.PhaseIndex();
+		return nResets;
+	}
+
+	void Count(const PacketFate_t& fate)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (fate.bLost)
+			m_counters.ulLost++;
+		if (fate.bReordered)
+			m_counters.ulReordered++;
+	}
+
+	void CountDelivered(size_t nBytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_counters.ulPackets++;
+		m_counters.ulBytes += nBytes;
+	}
+
+	void Enqueue(Pipe_t& pipe, const char* pData, size_t nSize, const ImpairmentPhase_t& phase, Clock::time_point now)
+	{
+		while (nSize > 0)
+		{
+			size_t nChunk = nSize < k_nSegmentSize ? nSize : k_nSegmentSize;
+			PacketFate_t fate = pipe.model.Schedule(phase, now, nChunk, true);
+			Count(fate);
+			pipe.queue.push_back(Segment_t{ fate.deliverAt, std::vector<char>(pData, pData + nChunk), 0 });
+			pipe.nQueuedBytes += nChunk;
+			pData += nChunk;
+			nSize -= nChunk;
+		}
+	}
+
+	// Sends what is due; returns false when the destination failed
+	bool Flush(Pipe_t& pipe, int fd, const ImpairmentPhase_t& phase, Clock::time_point now)
+	{
+		// an outage holds the data back, TCP would keep retransmitting it until the link is back
+		if (phase.bOutage)
+			return true;
+
+		while (!pipe.queue.empty() && pipe.queue.front().deliverAt <= now)
+		{
+			Segment_t& segment = pipe.queue.front();
+			ssize_t nSent = send(fd, segment.data.data() + segment.nSent, segment.data.size() - segment.nSent, MSG_NOSIGNAL);
+			if (nSent < 0)
+			{
+				pipe.bBlocked = errno == EAGAIN || errno == EWOULDBLOCK;
+				return pipe.bBlocked;
+			}
+
+			segment.nSent += nSent;
+			if (segment.nSent < segment.data.size())
+			{
+				pipe.bBlocked = true;
+				return true;
+			}
+
+			CountDelivered(segment.data.size());
+			pipe.nQueuedBytes -= segment.data.size();
+			pipe.queue.pop_front();
+		}
+		return true;
+	}
+
+	// Reads what fdSource has into pipe; returns false when the source failed
+	bool Receive(Pipe_t& pipe, int fdSource, const ImpairmentPhase_t& phase, Clock::time_point now)
+	{
+		char buffer[64 * 1024];
+		ssize_t nReceived = recv(fdSource, buffer, sizeof(buffer), 0);
+		if (nReceived > 0)
+			Enqueue(pipe, buffer, nReceived, phase, now);
+		else if (nReceived == 0)
+			pipe.bSourceClosed = true;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return false;
+		return true;
+	}
+
+	static Clock::time_point NextDue(const Pipe_t& pipe)
+	{
+		if (pipe.queue.empty() || pipe.bBlocked)
+			return Clock::time_point::max();
+		return pipe.queue.front().deliverAt;
+	}
+
+	static void Close(Connection_t& connection, bool bReset)
+	{
+		for (int fd : { connection.fdDown, connection.fdUp })
+		{
+			if (fd < 0)
+				continue;
+			if (bReset)
+				CloseWithReset(fd);
+			else
+				close(fd);
+		}
+		connection.fdDown = connection.fdUp = -1;
+	}
+
+	void Accept(int fdListen, std::vector<std::unique_ptr<Connection_t>>* pvecConnections, const ImpairmentPhase_t& phase)
+	{
+		while (true)
+		{
+			int fd = accept(fdListen, nullptr, nullptr);
+			if (fd < 0)
+				return;
+
+			if (phase.bRefuse)
+			{
+				CloseWithReset(fd);
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_counters.ulRefused++;
+				continue;
+			}
+
+			uint32_t unSeedUp = m_seeds();
+			uint32_t unSeedDown = m_seeds();
+			std::unique_ptr<Connection_t> pConnection(new Connection_t(unSeedUp, unSeedDown));
+			pConnection->fdDown = fd;
+			pConnection->fdUp = socket(AF_INET, SOCK_STREAM, 0);
+			SetNonBlocking(pConnection->fdDown);
+			SetNonBlocking(pConnection->fdUp);
+
+			// the impairment decides when data moves, the kernel shouldn't add its own batching
+			int nNoDelay = 1;
+			setsockopt(pConnection->fdDown, IPPROTO_TCP, TCP_NODELAY, &nNoDelay, sizeof(nNoDelay));
+			setsockopt(pConnection->fdUp, IPPROTO_TCP, TCP_NODELAY, &nNoDelay, sizeof(nNoDelay));
+
+			if (connect(pConnection->fdUp, (const sockaddr*)&m_targetAddr, sizeof(m_targetAddr)) != 0 && errno != EINPROGRESS)
+				pConnection->bDead = true;
+
+			pvecConnections->push_back(std::move(pConnection));
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_counters.ulConnections++;
+		}
+	}
+
+	static int PollTimeoutMs(Clock::time_point now, Clock::time_point next)
+	{
+		if (next <= now)
+			return 0;
+		double flMs = ceil(MsSince(now, next));
+		return flMs > 100.0 ? 100 : (int)flMs;
+	}
+
+	bool RunTcp()
+	{
+		int fdListen = OpenListener(m_listenAddr, false);
+		if (fdListen < 0)
+			return false;
+		m_unListenPort = BoundPort(fdListen);
+		m_bStarted = true;
+
+		CImpairmentSchedule schedule(m_profile, Clock::now());
+		std::vector<std::unique_ptr<Connection_t>> vecConnections;
+		std::vector<pollfd> vecPoll;
+
+		while (!g_bStop)
+		{
+			Clock::time_point now = Clock::now();
+			int nResets = AdvanceSchedule(schedule, now);
+			if (nResets > 0)
+			{
+				for (std::unique_ptr<Connection_t>& pConnection : vecConnections)
+					Close(*pConnection, true);
+				vecConnections.clear();
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_counters.ulResets += nResets;
+			}
+			const ImpairmentPhase_t& phase = schedule.Phase();
+
+			// deliver what is due and drop connections that are done
+			Clock::time_point next = schedule.PhaseEnd();
+			for (std::unique_ptr<Connection_t>& pConnection : vecConnections)
+			{
+				Connection_t& connection = *pConnection;
+				if (!connection.bDead && !connection.bConnecting)
+				{
+					connection.bDead = !Flush(connection.toDown, connection.fdDown, phase, now) || !Flush(connection.toUp, connection.fdUp, phase, now)
+						|| (connection.toDown.bSourceClosed && connection.toDown.queue.empty())
+						|| (connection.toUp.bSourceClosed && connection.toUp.queue.empty());
+				}
+				if (connection.bDead)
+					Close(connection, false);
+				else if (!phase.bOutage)
+					next = std::min(next, std::min(NextDue(connection.toDown), NextDue(connection.toUp)));
+			}
+			vecConnections.erase(std::remove_if(vecConnections.begin(), vecConnections.end(),
+				[](const std::unique_ptr<Connection_t>& pConnection) { return pConnection->bDead; }), vecConnections.end());
+
+			vecPoll.clear();
+			vecPoll.push_back(pollfd{ fdListen, POLLIN, 0 });
+			for (std::unique_ptr<Connection_t>& pConnection : vecConnections)
+			{
+				Connection_t& connection = *pConnection;
+				short sDown = 0;
+				short sUp = 0;
+				if (connection.bConnecting)
+				{
+					sUp = POLLOUT;
+				}
+				else
+				{
+					if (!connection.toUp.bSourceClosed && connection.toUp.nQueuedBytes < k_nMaxQueuedBytes)
+						sDown |= POLLIN;
+					if (!connection.toDown.bSourceClosed && connection.toDown.nQueuedBytes < k_nMaxQueuedBytes)
+						sUp |= POLLIN;
+					if (connection.toDown.bBlocked)
+						sDown |= POLLOUT;
+					if (connection.toUp.bBlocked)
+						sUp |= POLLOUT;
+				}
+				// poll() reports a hang-up even without events, so sockets with nothing to do are left out
+				vecPoll.push_back(pollfd{ sDown ? connection.fdDown : -1, sDown, 0 });
+				vecPoll.push_back(pollfd{ sUp ? connection.fdUp : -1, sUp, 0 });
+			}
+
+			if (poll(vecPoll.data(), vecPoll.size(), PollTimeoutMs(now, next)) < 0 && errno != EINTR)
+				break;
+			now = Clock::now();
+
+			for (size_t i = 0; i < vecConnections.size(); i++)
+			{
+				Connection_t& connection = *vecConnections[i];
+				short sDown = vecPoll[1 + 2 * i].revents;
+				short sUp = vecPoll[2 + 2 * i].revents;
+
+				if (connection.bConnecting)
+				{
+					if (sUp == 0)
+						continue;
+					int nError = 0;
+					socklen_t nLength = sizeof(nError);
+					getsockopt(connection.fdUp, SOL_SOCKET, SO_ERROR, &nError, &nLength);
+					connection.bConnecting = false;
+					connection.bDead = nError != 0;
+					continue;
+				}
+
+				if (sDown & POLLOUT)
+					connection.toDown.bBlocked = false;
+				if (sUp & POLLOUT)
+					connection.toUp.bBlocked = false;
+				if ((sDown & (POLLIN | POLLHUP | POLLERR)) && !Receive(connection.toUp, connection.fdDown, phase, now))
+					connection.bDead = true;
+				if ((sUp & (POLLIN | POLLHUP | POLLERR)) && !Receive(connection.toDown, connection.fdUp, phase, now))
+					connection.bDead = true;
+			}
+
+			if (vecPoll[0].revents & POLLIN)
+				Accept(fdListen, &vecConnections, phase);
+		}
+
+		for (std::unique_ptr<Connection_t>& pConnection : vecConnections)
+			Close(*pConnection, false);
+		close(fdListen);
+		return true;
+	}
+
+	typedef std::multimap<Clock::time_point, std::vector<char>> DatagramQueue_t;
+
+	void FlushDatagrams(DatagramQueue_t& queue, int fd, const sockaddr_in* pTo, Clock::time_point now)
+	{
+		while (!queue.empty() && queue.begin()->first <= now)
+		{
+			const std::vector<char>& datagram = queue.begin()->second;
+			// a datagram the other end isn't there for is lost, as it would be on the wire
+			if (sendto(fd, datagram.data(), datagram.size(), 0, (const sockaddr*)pTo, pTo ? sizeof(*pTo) : 0) >= 0)
+				CountDelivered(datagram.size());
+			queue.erase(queue.begin());
+		}
+	}
+
+	void ReceiveDatagrams(int fd, CLinkModel& model, DatagramQueue_t& queue, sockaddr_in* pFrom, const ImpairmentPhase_t& phase, Clock::time_point now)
+	{
+		char buffer[64 * 1024];
+		while (true)
+		{
+			socklen_t nFromLength = sizeof(sockaddr_in);
+			ssize_t nReceived = recvfrom(fd, buffer, sizeof(buffer), 0, (sockaddr*)pFrom, pFrom ? &nFromLength : nullptr);
+			if (nReceived < 0)
+			{
+				// ECONNREFUSED from an earlier send just means nobody was listening yet
+				if (errno == ECONNREFUSED || errno == EINTR)
+					continue;
+				return;
+			}
+
+			PacketFate_t fate = model.Schedule(phase, now, nReceived, false);
+			Count(fate);
+			if (!fate.bDropped)
+				queue.insert(std::make_pair(fate.deliverAt, std::vector<char>(buffer, buffer + nReceived)));
+		}
+	}
+
+	bool RunUdp()
+	{
+		int fdListen = OpenListener(m_listenAddr, true);
+		if (fdListen < 0)
+			return false;
+
+		int fdTarget = socket(AF_INET, SOCK_DGRAM, 0);
+		connect(fdTarget, (const sockaddr*)&m_targetAddr, sizeof(m_targetAddr));
+		SetNonBlocking(fdTarget);
+		m_unListenPort = BoundPort(fdListen);
+		m_bStarted = true;
+
+		CImpairmentSchedule schedule(m_profile, Clock::now());
+		CLinkModel toTarget(m_seeds());
+		CLinkModel toClient(m_seeds());
+		DatagramQueue_t queueToTarget;
+		DatagramQueue_t queueToClient;
+
+		// replies go to whoever sent last
+		sockaddr_in clientAddr;
+		memset(&clientAddr, 0, sizeof(clientAddr));
+		bool bHaveClient = false;
+
+		while (!g_bStop)
+		{
+			Clock::time_point now = Clock::now();
+			int nResets = AdvanceSchedule(schedule, now);
+			if (nResets > 0)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_counters.ulResets += nResets;
+			}
+			const ImpairmentPhase_t& phase = schedule.Phase();
+
+			FlushDatagrams(queueToTarget, fdTarget, nullptr, now);
+			if (bHaveClient)
+				FlushDatagrams(queueToClient, fdListen, &clientAddr, now);
+			else
+				queueToClient.clear();
+
+			Clock::time_point next = schedule.PhaseEnd();
+			if (!queueToTarget.empty())
+				next = std::min(next, queueToTarget.begin()->first);
+			if (!queueToClient.empty())
+				next = std::min(next, queueToClient.begin()->first);
+
+			pollfd pollFds[2] = { { fdListen, POLLIN, 0 }, { fdTarget, POLLIN, 0 } };
+			if (poll(pollFds, 2, PollTimeoutMs(now, next)) < 0 && errno != EINTR)
+				break;
+			now = Clock::now();
+
+			if (pollFds[0].revents & POLLIN)
+			{
+				ReceiveDatagrams(fdListen, toTarget, queueToTarget, &clientAddr, phase, now);
+				bHaveClient = true;
+			}
+			if (pollFds[1].revents & (POLLIN | POLLERR))
+				ReceiveDatagrams(fdTarget, toClient, queueToClient, nullptr, phase, now);
+		}
+
+		close(fdTarget);
+		close(fdListen);
+		return true;
+	}
+
+	const CImpairmentProfile& m_profile;
+	sockaddr_in m_listenAddr;
+	sockaddr_in m_targetAddr;
+	bool m_bUdp;
+	std::mt19937 m_seeds;
+
+	std::atomic<bool> m_bStarted{ false };
+	std::atomic<uint16_t> m_unListenPort{ 0 };
+	std::atomic<uint32_t> m_unPhase{ 0 };
+
+	std::mutex m_mutex;
+	ProxyCounters_t m_counters;
+};
+
+// --------------------------------------------------------------------------
+// Soak test
+// --------------------------------------------------------------------------
+
+// The sequence number travels in quat[0], where a float holds integers exactly up to 2^24
+static const uint32_t k_unSequenceMask = 0xffffff;
+
+// Extends a 24-bit sequence number to the full one closest to ulNear
+static uint64_t UnwrapSequence(uint32_t unSequence, uint64_t ulNear)
+{
+	uint32_t unDelta = (unSequence - (uint32_t)ulNear) & k_unSequenceMask;
+	if (unDelta < (k_unSequenceMask + 1) / 2)
+		return ulNear + unDelta;
+	uint64_t ulBack = (k_unSequenceMask + 1) - unDelta;
+	return ulNear >= ulBack ? ulNear - ulBack : 0;
+}
+
+// --------------------------------------------------------------------------
+// Purpose: Produces pose samples at a fixed rate, like the tracker on the
+//          glasses, and sends them to whoever is connected. Samples made
+//          while nobody is connected are never delivered, which the
+//          receiver counts as missing.
+// --------------------------------------------------------------------------
+class CSoakSender
+{
+public:
+	// enough history to date a pose that is many minutes old
+	static const size_t k_nHistory = 1 << 20;
+
+	CSoakSender() : m_pProducedUs(new std::atomic<uint64_t>[k_nHistory]()) {}
+
+	// TCP: waits for connections on an ephemeral port, like the glasses
+	bool OpenTcp()
+	{
+		sockaddr_in addr;
+		ParseAddress("0", &addr);
+		m_fdListen = OpenListener(addr, false);
+		return m_fdListen >= 0;
+	}
+
+	// UDP: sends every sample to target
+	void OpenUdp(const sockaddr_in& target)
+	{
+		m_bUdp = true;
+		m_fdConnection = socket(AF_INET, SOCK_DGRAM, 0);
+		connect(m_fdConnection, (const sockaddr*)&target, sizeof(target));
+		SetNonBlocking(m_fdConnection);
+	}
+
+	uint16_t ListenPort() const { return BoundPort(m_fdListen); }
+
+	void Run(double flRateHz)
+	{
+		Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / flRateHz));
+		Clock::time_point next = Clock::now();
+		while (!g_bStop)
+		{
+			std::this_thread::sleep_until(next);
+			next += period;
+			if (Clock::now() - next > std::chrono::seconds(1))
+				next = Clock::now();
+
+			if (!m_bUdp)
+				AcceptLatest();
+
+			uint64_t ulSequence = m_ulProduced;
+			m_pProducedUs[ulSequence % k_nHistory] = NowUs();
+			m_ulProduced = ulSequence + 1;
+
+			float quat[4] = { (float)(ulSequence & k_unSequenceMask), 0.f, 0.f, 1.f };
+			if (m_fdConnection >= 0)
+				Send((const char*)quat, sizeof(quat));
+		}
+
+		if (m_fdConnection >= 0)
+			close(m_fdConnection);
+		if (m_fdListen >= 0)
+			close(m_fdListen);
+	}
+
+	uint64_t Produced() const { return m_ulProduced; }
+
+	// When sample ulSequence was made; the oldest one still known if it's too old
+	uint64_t ProducedUs(uint64_t ulSequence) const
+	{
+		uint64_t ulProduced = m_ulProduced;
+		if (ulSequence + k_nHistory <= ulProduced)
+			ulSequence = ulProduced - k_nHistory + 1;
+		return m_pProducedUs[ulSequence % k_nHistory];
+	}
+
+private:
+	// A reconnecting receiver gets a new connection through the proxy, the newest one wins
+	void AcceptLatest()
+	{
+		int fd;
+		while ((fd = accept(m_fdListen, nullptr, nullptr)) >= 0)
+		{
+			if (m_fdConnection >= 0)
+				close(m_fdConnection);
+			m_fdConnection = fd;
+			m_vecPending.clear();
+			SetNonBlocking(fd);
+			int nNoDelay = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nNoDelay, sizeof(nNoDelay));
+		}
+	}
+
+	void Send(const char* pData, size_t nSize)
+	{
+		if (m_bUdp)
+		{
+			send(m_fdConnection, pData, nSize, 0);
+			return;
+		}
+
+		// samples queue up behind a full socket instead of blocking the sample clock
+		m_vecPending.insert(m_vecPending.end(), pData, pData + nSize);
+		ssize_t nSent = send(m_fdConnection, m_vecPending.data(), m_vecPending.size(), MSG_NOSIGNAL);
+		if (nSent > 0)
+			m_vecPending.erase(m_vecPending.begin(), m_vecPending.begin() + nSent);
+		else if (nSent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+			Disconnect();
+
+		if (m_vecPending.size() > k_nMaxPending)
+		{
+			fprintf(stderr, "soak: sender backlog over %zu bytes, dropping the connection\n", k_nMaxPending);
+			Disconnect();
+		}
+	}
+
+	void Disconnect()
+	{
+		close(m_fdConnection);
+		m_fdConnection = -1;
+		m_vecPending.clear();
+	}
+
+	static const size_t k_nMaxPending = 4 << 20;
+
+	bool m_bUdp = false;
+	int m_fdListen = -1;
+	int m_fdConnection = -1;
+	std::vector<char> m_vecPending;
+
+	std::atomic<uint64_t> m_ulProduced{ 0 };
+	std::unique_ptr<std::atomic<uint64_t>[]> m_pProducedUs;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: The driver's TCP receive loop (ReceiveThread and ReceiveTCP in
+//          driver.cpp) on POSIX sockets. Every recv() goes through the
+//          driver's ReceivePoseStream and reconnects are timed by its
+//          CReconnectPacer, so the framing, the pose publish and the
+//          reconnect policy under test are the driver's own code. What is
+//          left here is the socket calls: connect, recv with a 100 ms
+//          timeout, close. With --udp it reads datagrams from a bound
+//          socket, which the driver doesn't do.
+// --------------------------------------------------------------------------
+class CSoakReceiver
+{
+public:
+	struct Counters_t
+	{
+		uint64_t ulPackets = 0;
+		uint64_t ulMissing = 0;			// samples since the first received one that never arrived
+		uint64_t ulOutOfOrder = 0;
+		uint64_t ulDisconnects = 0;
+		uint64_t ulConnectFailures = 0;
+		std::vector<double> vecReconnectMs;	// from losing the connection to the first pose after it
+	};
+
+	bool Open(bool bUdp)
+	{
+		m_bUdp = bUdp;
+		if (!bUdp)
+			return true;
+
+		sockaddr_in addr;
+		ParseAddress("0", &addr);
+		m_fdUdp = OpenListener(addr, true);
+		return m_fdUdp >= 0;
+	}
+
+	uint16_t UdpPort() const { return BoundPort(m_fdUdp); }
+
+	void Run(const sockaddr_in& addr)
+	{
+		char buffer[64 * k_nPosePacketSize];
+		int fd = m_bUdp ? m_fdUdp : -1;
+		bool bLost = false;
+		Clock::time_point lostAt;
+		CReconnectPacer pacer;
+		timeval receiveTimeout = { 0, 100000 };
+		if (m_bUdp)
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &receiveTimeout, sizeof(receiveTimeout));
+
+		while (!g_bStop)
+		{
+			if (fd < 0)
+			{
+				fd = socket(AF_INET, SOCK_STREAM, 0);
+				if (connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0)
+				{
+					close(fd);
+					fd = -1;
+					Locked([](Counters_t& counters) { counters.ulConnectFailures++; });
+					SleepUnlessStopped(pacer.DelayAfterConnectFailure());
+					continue;
+				}
+				setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &receiveTimeout, sizeof(receiveTimeout));
+				m_packetReader.Reset();
+				pacer.Connected(CReconnectPacer::Clock::now());
+			}
+
+			ssize_t nReceived = recv(fd, buffer, sizeof(buffer), 0);
+			if (nReceived < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				continue;
+			if (nReceived <= 0 && !m_bUdp)
+			{
+				// the end of the run closes the connection too, that isn't a loss
+				if (g_bStop)
+					break;
+				close(fd);
+				fd = -1;
+				m_bSourceAlive = false;
+				if (!bLost)
+					lostAt = Clock::now();
+				bLost = true;
+				Locked([](Counters_t& counters) { counters.ulDisconnects++; });
+				SleepUnlessStopped(pacer.DelayAfterConnectionLost(CReconnectPacer::Clock::now()));
+				continue;
+			}
+			if (nReceived <= 0)
+				continue;
+
+			int nPackets = ReceivePoseStream(&m_packetReader, &m_poseState, buffer, (int)nReceived);
+			if (nPackets == 0)
+				continue;
+
+			m_bSourceAlive = true;
+			m_bHaveSample = true;
+
+			// this thread is the only writer, so what it reads back is what it just published
+			uint64_t ulSequence = UnwrapSequence((uint32_t)m_poseState.Read().quat[0], m_ulLastSequence);
+			Clock::time_point now = Clock::now();
+			Locked([&](Counters_t& counters) {
+				if (m_bFirstPacket)
+					m_ulFirstSequence = ulSequence + 1 - nPackets;
+				else if (ulSequence < m_ulLastSequence)
+					counters.ulOutOfOrder++;
+				m_ulLastSequence = std::max(m_ulLastSequence, ulSequence);
+				m_bFirstPacket = false;
+				counters.ulPackets += nPackets;
+				if (bLost)
+					counters.vecReconnectMs.push_back(MsSince(lostAt, now));
+			});
+			bLost = false;
+		}
+
+		if (fd >= 0)
+			close(fd);
+	}
+
+	const CPoseState& PoseState() const { return m_poseState; }
+	bool HaveSample() const { return m_bHaveSample; }
+	bool SourceAlive() const { return m_bSourceAlive; }
+
+	Counters_t GetCounters()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Counters_t counters = m_counters;
+		// nothing duplicates samples, so whatever of the span didn't arrive is missing; a late
+		// datagram stops counting as missing once it shows up
+		if (!m_bFirstPacket)
+			counters.ulMissing = m_ulLastSequence + 1 - m_ulFirstSequence - std::min(counters.ulPackets, m_ulLastSequence + 1 - m_ulFirstSequence);
+		return counters;
+	}
+
+private:
+	template <typename Func>
+	void Locked(Func func)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		func(m_counters);
+	}
+
+	bool m_bUdp = false;
+	int m_fdUdp = -1;
+	CPosePacketReader m_packetReader;
+	CPoseState m_poseState;
+	std::atomic<bool> m_bHaveSample{ false };
+	std::atomic<bool> m_bSourceAlive{ false };
+
+	// written under the lock; the receive thread, the only writer, also reads them without it
+	std::mutex m_mutex;
+	Counters_t m_counters;
+	bool m_bFirstPacket = true;
+	uint64_t m_ulFirstSequence = 0;
+	uint64_t m_ulLastSequence = 0;
+};
+
+// --------------------------------------------------------------------------
+// Purpose: Pose ages in log-linear buckets, 16 per power of two (about 6%
+//          resolution), from 1 us to beyond an hour
+// --------------------------------------------------------------------------
+class CAgeHistogram
+{
+public:
+	void Add(uint64_t ulUs)
+	{
+		m_ulBuckets[Bucket(ulUs)]++;
+		m_ulCount++;
+		m_ulMaxUs = std::max(m_ulMaxUs, ulUs);
+	}
+
+	void Clear() { *this = CAgeHistogram(); }
+
+	uint64_t Count() const { return m_ulCount; }
+	double MaxMs() const { return m_ulMaxUs / 1000.0; }
+
+	// flFraction in [0, 1]; the middle of the bucket it falls into
+	double PercentileMs(double flFraction) const
+	{
+		if (m_ulCount == 0)
+			return 0.0;
+		uint64_t ulRank = (uint64_t)ceil(flFraction * m_ulCount);
+		uint64_t ulSeen = 0;
+		for (int i = 0; i < k_nBuckets; i++)
+		{
+			ulSeen += m_ulBuckets[i];
+			if (ulSeen >= ulRank && m_ulBuckets[i] > 0)
+				return std::min((double)m_ulMaxUs, BucketMiddleUs(i)) / 1000.0;
+		}
+		return MaxMs();
+	}
+
+private:
+	static const int k_nSubBuckets = 16;
+	static const int k_nBuckets = k_nSubBuckets + 40 * k_nSubBuckets;
+
+	static int Bucket(uint64_t ulUs)
+	{
+		if (ulUs < k_nSubBuckets)
+			return (int)ulUs;
+		int nExponent = 63 - __builtin_clzll(ulUs);
+		int nSub = (int)(ulUs >> (nExponent - 4)) & (k_nSubBuckets - 1);
+		return std::min(k_nSubBuckets + (nExponent - 4) * k_nSubBuckets + nSub, k_nBuckets - 1);
+	}
+
+	static double BucketMiddleUs(int nBucket)
+	{
+		if (nBucket < k_nSubBuckets)
+			return nBucket;
+		int nExponent = (nBucket - k_nSubBuckets) / k_nSubBuckets + 4;
+		int nSub = (nBucket - k_nSubBuckets) % k_nSubBuckets;
+		double flWidth = ldexp(1.0, nExponent - 4);
+		return ldexp(1.0, nExponent) + (nSub + 0.5) * flWidth;
+	}
+
+	uint64_t m_ulBuckets[k_nBuckets] = {};
+	uint64_t m_ulCount = 0;
+	uint64_t m_ulMaxUs = 0;
+};
+
+static double PercentileOf(std::vector<double> vecValues, double flFraction)
+{
+	if (vecValues.empty())
+		return 0.0;
+	std::sort(vecValues.begin(), vecValues.end());
+	size_t nIndex = (size_t)ceil(flFraction * vecValues.size());
+	return vecValues[std::min(nIndex, vecValues.size()) - (nIndex > 0 ? 1 : 0)];
+}
+
+// --------------------------------------------------------------------------
+// Purpose: Reads the pose the way GetPose does, at the compositor's rate,
+//          and tracks how old it is. A stall lasts from the first poll that
+//          sees a pose older than the stale limit to the first one that
+//          sees a fresh pose again.
+// --------------------------------------------------------------------------
+class CFreshnessSampler
+{
+public:
+	struct Stats_t
+	{
+		CAgeHistogram interval;
+		CAgeHistogram total;
+		uint64_t ulIntervalStale = 0;
+		uint64_t ulTotalStale = 0;
+		uint64_t ulTotalOutOfRange = 0;
+		uint64_t ulIntervalStalls = 0;
+		std::vector<double> vecStallMs;
+		double flOngoingStallMs = 0.0;	// a stall that hasn't recovered yet
+	};
+
+	CFreshnessSampler(const CSoakSender& sender, const CSoakReceiver& receiver, double flStaleMs)
+		: m_sender(sender), m_receiver(receiver), m_ulStaleUs((uint64_t)(flStaleMs * 1000.0))
+	{
+	}
+
+	void Run(double flPollHz)
+	{
+		Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / flPollHz));
+		Clock::time_point next = Clock::now();
+		while (!g_bStop)
+		{
+			std::this_thread::sleep_until(next);
+			next += period;
+			if (!m_receiver.HaveSample())
+				continue;
+
+			PoseSample_t sample = m_receiver.PoseState().Read();
+			uint64_t ulProduced = m_sender.Produced();
+			uint64_t ulSequence = UnwrapSequence((uint32_t)sample.quat[0], ulProduced > 0 ? ulProduced - 1 : 0);
+			uint64_t ulNowUs = NowUs();
+			uint64_t ulProducedUs = m_sender.ProducedUs(ulSequence);
+			uint64_t ulAgeUs = ulNowUs > ulProducedUs ? ulNowUs - ulProducedUs : 0;
+			bool bStale = ulAgeUs > m_ulStaleUs;
+			Clock::time_point now = Clock::now();
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stats.interval.Add(ulAgeUs);
+			m_stats.total.Add(ulAgeUs);
+			if (bStale)
+			{
+				m_stats.ulIntervalStale++;
+				m_stats.ulTotalStale++;
+			}
+			if (!m_receiver.SourceAlive())
+				m_stats.ulTotalOutOfRange++;
+
+			if (bStale && !m_bStalled)
+			{
+				m_stallStart = now;
+				m_stats.ulIntervalStalls++;
+			}
+			else if (!bStale && m_bStalled)
+			{
+				m_stats.vecStallMs.push_back(MsSince(m_stallStart, now));
+			}
+			m_bStalled = bStale;
+		}
+	}
+
+	// Hands out the stats and starts the next interval
+	Stats_t TakeInterval()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Stats_t stats = m_stats;
+		stats.flOngoingStallMs = m_bStalled ? MsSince(m_stallStart, Clock::now()) : 0.0;
+		m_stats.interval.Clear();
+		m_stats.ulIntervalStale = 0;
+		m_stats.ulIntervalStalls = 0;
+		return stats;
+	}
+
+private:
+	const CSoakSender& m_sender;
+	const CSoakReceiver& m_receiver;
+	uint64_t m_ulStaleUs;
+
+	std::mutex m_mutex;
+	Stats_t m_stats;
+	bool m_bStalled = false;
+	Clock::time_point m_stallStart;
+};
+
+struct SoakOptions_t
+{
+	double flDurationMs = 60000.0;
+	double flRateHz = 500.0;
+	double flPollHz = 90.0;
+	double flStaleMs = 50.0;
+	double flReportMs = 10000.0;
+	double flMaxRecoveryMs = 0.0;	// 0 doesn't check
+	bool bUdp = false;
+	std::string sCsvPath;
+};
+
+static int RunSoak(const SoakOptions_t& options, const CImpairmentProfile& profile, uint32_t unSeed)
+{
+	CSoakSender sender;
+	CSoakReceiver receiver;
+	if (!receiver.Open(options.bUdp))
+		return 1;
+
+	// TCP: sender <- proxy <- receiver connects, like the driver connecting to the glasses.
+	// UDP: sender -> proxy -> receiver.
+	sockaddr_in listenAddr;
+	sockaddr_in targetAddr;
+	ParseAddress("0", &listenAddr);
+	if (options.bUdp)
+		ParseAddress(std::to_string(receiver.UdpPort()), &targetAddr);
+	else if (sender.OpenTcp())
+		ParseAddress(std::to_string(sender.ListenPort()), &targetAddr);
+	else
+		return 1;
+
+	CImpairmentProxy proxy(profile, listenAddr, targetAddr, options.bUdp, unSeed);
+	std::thread proxyThread([&proxy] { proxy.Run(); });
+	uint16_t unProxyPort = proxy.WaitForListenPort();
+	if (unProxyPort == 0)
+	{
+		g_bStop = true;
+		proxyThread.join();
+		return 1;
+	}
+
+	sockaddr_in proxyAddr;
+	ParseAddress(std::to_string(unProxyPort), &proxyAddr);
+	if (options.bUdp)
+		sender.OpenUdp(proxyAddr);
+
+	CFreshnessSampler sampler(sender, receiver, options.flStaleMs);
+	std::thread senderThread([&] { sender.Run(options.flRateHz); });
+	std::thread receiverThread([&] { receiver.Run(proxyAddr); });
+	std::thread samplerThread([&] { sampler.Run(options.flPollHz); });
+
+	FILE* pCsv = nullptr;
+	if (!options.sCsvPath.empty())
+	{
+		pCsv = fopen(options.sCsvPath.c_str(), "w");
+		if (pCsv)
+			fprintf(pCsv, "elapsed_s,phase,fresh_p50_ms,fresh_p99_ms,fresh_max_ms,stale_pct,stalls,missing,disconnects,connect_failures\n");
+	}
+
+	printf("soak: %s, %.0f Hz samples, %.0f Hz polls, stale above %.0f ms, %.0f s\n",
+		options.bUdp ? "udp" : "tcp", options.flRateHz, options.flPollHz, options.flStaleMs, options.flDurationMs / 1000.0);
+
+	Clock::time_point start = Clock::now();
+	Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(options.flDurationMs));
+	Clock::time_point nextReport = start;
+	uint64_t ulLastMissing = 0;
+	uint64_t ulLastDisconnects = 0;
+	CFreshnessSampler::Stats_t stats;
+	CSoakReceiver::Counters_t counters;
+
+	while (!g_bStop)
+	{
+		nextReport += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(options.flReportMs));
+		while (!g_bStop && Clock::now() < std::min(nextReport, end))
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		stats = sampler.TakeInterval();
+		counters = receiver.GetCounters();
+		double flElapsedS = MsSince(start, Clock::now()) / 1000.0;
+		double flStalePercent = stats.interval.Count() ? 100.0 * stats.ulIntervalStale / stats.interval.Count() : 0.0;
+		std::string sPhase = proxy.PhaseName();
+
+		printf("[%8.1f s] %-12s fresh p50 %7.2f  p99 %7.2f  max %8.2f ms  stale %5.1f%%  stalls %llu  missing %llu  disconnects %llu\n",
+			flElapsedS, sPhase.c_str(), stats.interval.PercentileMs(0.5), stats.interval.PercentileMs(0.99), stats.interval.MaxMs(), flStalePercent,
+			(unsigned long long)stats.ulIntervalStalls, (unsigned long long)(counters.ulMissing - ulLastMissing),
+			(unsigned long long)(counters.ulDisconnects - ulLastDisconnects));
+		fflush(stdout);
+		if (pCsv)
+		{
+			fprintf(pCsv, "%.1f,%s,%.3f,%.3f,%.3f,%.2f,%llu,%llu,%llu,%llu\n", flElapsedS, sPhase.c_str(),
+				stats.interval.PercentileMs(0.5), stats.interval.PercentileMs(0.99), stats.interval.MaxMs(), flStalePercent,
+				(unsigned long long)stats.ulIntervalStalls, (unsigned long long)(counters.ulMissing - ulLastMissing),
+				(unsigned long long)(counters.ulDisconnects - ulLastDisconnects), (unsigned long long)counters.ulConnectFailures);
+			fflush(pCsv);
+		}
+		ulLastMissing = counters.ulMissing;
+		ulLastDisconnects = counters.ulDisconnects;
+
+		if (Clock::now() >= end)
+			break;
+	}
+
+	g_bStop = true;
+	senderThread.join();
+	receiverThread.join();
+	samplerThread.join();
+	proxyThread.join();
+	if (pCsv)
+		fclose(pCsv);
+
+	stats = sampler.TakeInterval();
+	counters = receiver.GetCounters();
+	ProxyCounters_t proxyCounters = proxy.GetCounters();
+	uint64_t ulProduced = sender.Produced();
+	double flStallMax = stats.vecStallMs.empty() ? 0.0 : *std::max_element(stats.vecStallMs.begin(), stats.vecStallMs.end());
+	flStallMax = std::max(flStallMax, stats.flOngoingStallMs);
+	double flPolls = (double)std::max<uint64_t>(stats.total.Count(), 1);
+
+	printf("\nsoak: %.1f s, %llu samples produced, %llu received\n", MsSince(start, Clock::now()) / 1000.0,
+		(unsigned long long)ulProduced, (unsigned long long)counters.ulPackets);
+	printf("  freshness    p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f ms\n", stats.total.PercentileMs(0.5), stats.total.PercentileMs(0.9),
+		stats.total.PercentileMs(0.99), stats.total.PercentileMs(0.999), stats.total.MaxMs());
+	printf("  stale        %.3f%% of polls, out of range %.3f%%\n", 100.0 * stats.ulTotalStale / flPolls, 100.0 * stats.ulTotalOutOfRange / flPolls);
+	printf("  missing      %llu samples (%.3f%%), %llu out of order\n", (unsigned long long)counters.ulMissing,
+		ulProduced ? 100.0 * counters.ulMissing / ulProduced : 0.0, (unsigned long long)counters.ulOutOfOrder);
+	printf("  stalls       %zu, recovery p50 %.1f  p90 %.1f  max %.1f ms%s\n", stats.vecStallMs.size(), PercentileOf(stats.vecStallMs, 0.5),
+		PercentileOf(stats.vecStallMs, 0.9), flStallMax, stats.flOngoingStallMs > 0.0 ? ", one still stalled at the end" : "");
+	printf("  connections  %llu lost, %llu failed connects, first pose after reconnect p50 %.1f  max %.1f ms\n",
+		(unsigned long long)counters.ulDisconnects, (unsigned long long)counters.ulConnectFailures, PercentileOf(counters.vecReconnectMs, 0.5),
+		PercentileOf(counters.vecReconnectMs, 1.0));
+	printf("  proxy        %llu packets, %llu lost, %llu reordered, %llu resets, %llu refused\n", (unsigned long long)proxyCounters.ulPackets,
+		(unsigned long long)proxyCounters.ulLost, (unsigned long long)proxyCounters.ulReordered, (unsigned long long)proxyCounters.ulResets,
+		(unsigned long long)proxyCounters.ulRefused);
+
+	if (options.flMaxRecoveryMs > 0.0 && flStallMax > options.flMaxRecoveryMs)
+	{
+		printf("\nFAIL: a stall took %.1f ms to recover, more than %.1f ms\n", flStallMax, options.flMaxRecoveryMs);
+		return 1;
+	}
+	return 0;
+}
+
+static int RunProxy(const sockaddr_in& listenAddr, const sockaddr_in& targetAddr, bool bUdp, double flReportMs, const CImpairmentProfile& profile, uint32_t unSeed)
+{
+	CImpairmentProxy proxy(profile, listenAddr, targetAddr, bUdp, unSeed);
+	bool bResult = true;
+	std::thread proxyThread([&] { bResult = proxy.Run(); });
+	uint16_t unPort = proxy.WaitForListenPort();
+	if (unPort != 0)
+		printf("netproxy: %s on port %u\n", bUdp ? "udp" : "tcp", unPort);
+
+	Clock::time_point start = Clock::now();
+	Clock::time_point nextReport = start;
+	while (unPort != 0 && !g_bStop)
+	{
+		nextReport += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(flReportMs));
+		while (!g_bStop && Clock::now() < nextReport)
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		ProxyCounters_t counters = proxy.GetCounters();
+		printf("[%8.1f s] %-12s %llu packets, %.1f kB, %llu lost, %llu reordered, %llu connections, %llu resets, %llu refused\n",
+			MsSince(start, Clock::now()) / 1000.0, proxy.PhaseName().c_str(), (unsigned long long)counters.ulPackets, counters.ulBytes / 1000.0,
+			(unsigned long long)counters.ulLost, (unsigned long long)counters.ulReordered, (unsigned long long)counters.ulConnections,
+			(unsigned long long)counters.ulResets, (unsigned long long)counters.ulRefused);
+		fflush(stdout);
+	}
+
+	g_bStop = true;
+	proxyThread.join();
+	return bResult ? 0 : 1;
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: netproxy proxy --listen <[ip:]port> --target <ip:port> [--udp] [impairment] [--report <duration>]\n"
+		"       netproxy soak [--duration <duration>] [--rate <hz>] [--poll <hz>] [--stale <ms>] [--udp] [impairment]\n"
+		"                     [--report <duration>] [--csv <file>] [--max-recovery <ms>]\n"
+		"impairment: --profile <file> | --impair \"<key=value ...>\", --seed <n>\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		Usage();
+		return 2;
+	}
+
+	std::string sMode = argv[1];
+	SoakOptions_t soak;
+	sockaddr_in listenAddr;
+	sockaddr_in targetAddr;
+	bool bHaveListen = false;
+	bool bHaveTarget = false;
+	// a clean link unless told otherwise
+	CImpairmentProfile profile;
+	std::string sUnused;
+	profile.FromSettings("", &sUnused);
+	uint32_t unSeed = 1;
+
+	for (int i = 2; i < argc; i++)
+	{
+		std::string sArg = argv[i];
+		const char* pchValue = i + 1 < argc ? argv[i + 1] : nullptr;
+		bool bOk = true;
+		std::string sError;
+
+		if (sArg == "--udp")
+		{
+			soak.bUdp = true;
+			continue;
+		}
+		if (!pchValue)
+		{
+			Usage();
+			return 2;
+		}
+		i++;
+
+		double flNumber = atof(pchValue);
+		if (sArg == "--listen")
+			bOk = bHaveListen = ParseAddress(pchValue, &listenAddr);
+		else if (sArg == "--target")
+			bOk = bHaveTarget = ParseAddress(pchValue, &targetAddr);
+		else if (sArg == "--profile")
+			bOk = profile.Load(pchValue, &sError);
+		else if (sArg == "--impair")
+			bOk = profile.FromSettings(pchValue, &sError);
+		else if (sArg == "--seed")
+			unSeed = (uint32_t)strtoul(pchValue, nullptr, 10);
+		else if (sArg == "--duration")
+			bOk = ParseDuration(pchValue, &soak.flDurationMs);
+		else if (sArg == "--report")
+			bOk = ParseDuration(pchValue, &soak.flReportMs) && soak.flReportMs > 0.0;
+		else if (sArg == "--rate")
+			bOk = (soak.flRateHz = flNumber) > 0.0;
+		else if (sArg == "--poll")
+			bOk = (soak.flPollHz = flNumber) > 0.0;
+		else if (sArg == "--stale")
+			bOk = (soak.flStaleMs = flNumber) > 0.0;
+		else if (sArg == "--max-recovery")
+			bOk = (soak.flMaxRecoveryMs = flNumber) > 0.0;
+		else if (sArg == "--csv")
+			soak.sCsvPath = pchValue;
+		else
+			bOk = false;
+
+		if (!bOk)
+		{
+			fprintf(stderr, "netproxy: bad %s %s%s%s\n", sArg.c_str(), pchValue, sError.empty() ? "" : ": ", sError.c_str());
+			return 2;
+		}
+	}
+
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (sMode == "soak")
+		return RunSoak(soak, profile, unSeed);
+	if (sMode == "proxy" && bHaveListen && bHaveTarget)
+		return RunProxy(listenAddr, targetAddr, soak.bUdp, soak.flReportMs, profile, unSeed);
+
+	Usage();
+	return 2;
+}
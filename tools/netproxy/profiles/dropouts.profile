@@ -0,0 +1,10 @@
+# Roaming between access points: the link stalls, comes back, and now and
+# then the association drops and the glasses are unreachable for a while.
+
+30s  name=good     delay=2 jitter=2
+3s   name=stall    outage=1
+30s  name=good     delay=2 jitter=2
+reset
+5s   name=away     refuse=1
+30s  name=good     delay=2 jitter=2
+20s  name=narrow   delay=5 jitter=5 rate=200
@@ -0,0 +1,9 @@
+# Home Wi-Fi with a busy neighbourhood: a few ms of jitter, short loss bursts
+# and the occasional latency spike from a background scan. The pose stream
+# keeps the link busy, so TCP recovers most losses by fast retransmit within
+# a few round trips rather than waiting out the 200 ms retransmit timeout.
+
+60s  name=steady  delay=2 jitter=3 loss=0.2 burst=2 rto=15
+5s   name=scan    delay=40 jitter=80 loss=1 burst=4 rto=100
+60s  name=steady  delay=2 jitter=3 loss=0.2 burst=2 rto=15
+2s   name=spike   delay=250 jitter=50